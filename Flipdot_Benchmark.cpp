@@ -0,0 +1,115 @@
+/*
+   Benchmark for the UpdateSign() pipeline, see Flipdot_Benchmark.h
+*/
+#include "Arduino.h"
+#include "Flipdot_Benchmark.h"
+#include "Modbus_Scroller.h"
+
+static const char *const workloadNames[MCP_BENCH_WORKLOADS] = {
+  "all-on",
+  "all-off",
+  "text",
+  "circle",
+  "noise",
+  "scroll",
+};
+
+static void drawWorkload(mcp &sign, byte workload, unsigned int frame)
+{
+  switch (workload) {
+    case MCP_BENCH_ALL_ON:
+      sign.dotAllOn();
+      break;
+    case MCP_BENCH_ALL_OFF:
+      sign.dotAllOff();
+      break;
+    case MCP_BENCH_TEXT:
+      sign.dotAllOff();
+      sign.setFont();
+      sign.setTextSize(2);
+      sign.setTextColor(1);
+      sign.setCursor(1, 1);
+      sign.print(1234567UL + frame * 1111UL);
+      break;
+    case MCP_BENCH_CIRCLE:
+      sign.dotAllOff();
+      sign.fillCircle((frame * 7) % sign.width(), 7, 5, 1);
+      break;
+    case MCP_BENCH_NOISE:
+      for (int x = 0; x < sign.width(); x++) {
+        for (int y = 0; y < sign.height(); y++) {
+          sign.drawPixel(x, y, random(2));
+        }
+      }
+      break;
+    case MCP_BENCH_SCROLL: {
+      // The text is drawn once, on the first frame
+      static mcpScrollStrip<160> strip;
+      if (frame == 0) {
+        strip.clear();
+        strip.setTextSize(2);
+        strip.setCursor(0, 1);
+        strip.print(F("Route 42 Downtown"));
+        strip.setGap(12);
+      }
+      strip.drawTo(sign, frame * 2);
+      break;
+    }
+  }
+}
+
+void mcpBenchmarkRun(mcp &sign, byte workload, unsigned int frames, mcpBenchResult &result)
+{
+  // Every frame is sent with a full refresh, so each workload pays for
+  // every register and the numbers are comparable between runs.
+  randomSeed(42);
+  result.name = workloadNames[workload];
+  result.frames = frames;
+  result.renderMicros = 0;
+  sign.resetProfile();
+
+  for (unsigned int frame = 0; frame < frames; frame++) {
+    unsigned long start = MCP_PROFILE_MICROS();
+    drawWorkload(sign, workload, frame);
+    result.renderMicros += MCP_PROFILE_MICROS() - start;
+
+    sign.UpdateSign(true);
+  }
+
+  result.profile = sign.getProfile();
+}
+
+void mcpBenchmarkPrintHeader(Print &out)
+{
+  out.println(F("# Per frame averages, times in microseconds"));
+  out.println(F("# workload frames render convert encode write flush eol update lines bytes"));
+}
+
+void mcpBenchmarkPrint(Print &out, const mcpBenchResult &result)
+{
+  const mcpProfile &p = result.profile;
+  unsigned long n = result.frames ? result.frames : 1;
+  const unsigned long columns[] = {
+    result.renderMicros, p.convertMicros, p.encodeMicros, p.writeMicros,
+    p.flushMicros, p.eolMicros, p.updateMicros, p.lines, p.bytes,
+  };
+
+  out.print(result.name);
+  out.print(' ');
+  out.print(result.frames);
+  for (unsigned int i = 0; i < sizeof(columns) / sizeof(columns[0]); i++) {
+    out.print(' ');
+    out.print(columns[i] / n);
+  }
+  out.println();
+}
+
+void mcpBenchmarkAll(mcp &sign, Print &out, unsigned int frames)
+{
+  mcpBenchmarkPrintHeader(out);
+  for (byte workload = 0; workload < MCP_BENCH_WORKLOADS; workload++) {
+    mcpBenchResult result;
+    mcpBenchmarkRun(sign, workload, frames, result);
+    mcpBenchmarkPrint(out, result);
+  }
+}
@@ -0,0 +1,42 @@
+/*
+   Benchmark for the UpdateSign() pipeline.
+
+   Runs a set of representative workloads through a full UpdateSign() each
+   frame, and reports the time spent drawing plus the per-phase timing the
+   driver collects in mcpProfile (conversion, register encoding, serial
+   writes, waiting for the port to drain, and EOL delays).
+
+   Works on the MCU (prints to any Print, e.g. Serial) and in the host build
+   (see extras/host). Needs MCP_PROFILE set to 1 in Modbus_CoProcessor.h.
+*/
+#ifndef Flipdot_Benchmark_h
+#define Flipdot_Benchmark_h
+
+#include "Arduino.h"
+#include "Modbus_CoProcessor.h"
+
+enum mcpBenchWorkload
+{
+  MCP_BENCH_ALL_ON,
+  MCP_BENCH_ALL_OFF,
+  MCP_BENCH_TEXT,    // A changing number at text size 2, like the micros() demo
+  MCP_BENCH_CIRCLE,  // The moving fillCircle demo
+  MCP_BENCH_NOISE,   // Random dots
+  MCP_BENCH_SCROLL,  // Text at size 2 scrolling from a pre-rendered strip, see Modbus_Scroller.h
+  MCP_BENCH_WORKLOADS
+};
+
+struct mcpBenchResult
+{
+  const char *name;
+  unsigned int frames;
+  unsigned long renderMicros; // Drawing the frames with Adafruit_GFX
+  mcpProfile profile;         // Sending them, summed over all frames
+};
+
+void mcpBenchmarkRun(mcp &sign, byte workload, unsigned int frames, mcpBenchResult &result);
+void mcpBenchmarkAll(mcp &sign, Print &out, unsigned int frames = 10);
+void mcpBenchmarkPrintHeader(Print &out);
+void mcpBenchmarkPrint(Print &out, const mcpBenchResult &result);
+
+#endif
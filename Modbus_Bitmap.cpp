@@ -0,0 +1,274 @@
+/*
+   Column bitmap decoder for the Modbus_CoProcessor library, see Modbus_Bitmap.h,
+   and Adafruit_GFX's row bitmaps drawn a block of columns at a time.
+*/
+#include "Arduino.h"
+#include "Modbus_CoProcessor.h"
+
+// Moves a column's dots down by y, or up for negative y. Dots moved off the sign are lost.
+static uint16_t shiftColumn(uint16_t column, int16_t y)
+{
+  return (y >= 0) ? (uint16_t)(column << y) : (uint16_t)(column >> -y);
+}
+
+void mcp::drawColumnBitmap(int16_t x, int16_t y, const mcpBitmap &bitmap, mcpBlitMode mode)
+{
+  // Like drawColumns(), this draws in the sign's own orientation whatever the rotation
+  if (y <= -bitmap.height || y >= ySize) {
+    return;
+  }
+  uint16_t mask = shiftColumn((uint16_t)(((uint32_t)1 << bitmap.height) - 1), y);
+
+  const uint8_t *data = bitmap.data;
+  const uint8_t *end = data + bitmap.size;
+  int16_t column = x;
+  while (data < end && column < Layout.columns) {
+    byte count = pgm_read_byte(data++);
+    if (count >= mcpBitmapRun) {
+      // One word for the whole run
+      uint16_t bits = pgm_read_byte(data) | (uint16_t)pgm_read_byte(data + 1) << 8;
+      data += 2;
+      int16_t run = (count & 0x7F) + 2;
+      BlitColumns(column, run, shiftColumn(bits, y) & mask, mask, mode);
+      column += run;
+    } else {
+      for (int16_t i = 0; i <= count; i++) {
+        uint16_t bits = pgm_read_byte(data) | (uint16_t)pgm_read_byte(data + 1) << 8;
+        data += 2;
+        BlitColumns(column, 1, shiftColumn(bits, y) & mask, mask, mode);
+        column++;
+      }
+    }
+  }
+}
+
+void mcp::BlitColumns(int16_t x, int16_t w, uint16_t bits, uint16_t mask, mcpBlitMode mode)
+{
+  // Combine bits with the dots under mask in columns x thru x + w - 1, dots outside mask are kept
+  if (x < 0) {
+    w += x;
+    x = 0;
+  }
+  if (w > Layout.columns - x) {
+    w = Layout.columns - x;
+  }
+  uint16_t *column = &Framebuffer[x];
+  for (int16_t i = 0; i < w; i++) {
+    switch (mode) {
+      case mcpBlitCopy:
+        column[i] = (column[i] & ~mask) | bits;
+        break;
+      case mcpBlitOr:
+        column[i] |= bits;
+        break;
+      case mcpBlitAnd:
+        column[i] &= bits | ~mask;
+        break;
+      case mcpBlitXor:
+        column[i] ^= bits;
+        break;
+    }
+  }
+}
+
+// Adafruit_GFX bitmaps are stored a row at a time, 8 dots to a byte. Eight rows of one byte
+// column are turned into eight column bytes at once, then each is shifted into place in its
+// column word, so a bitmap costs a handful of word operations per 8x8 block instead of a
+// drawPixel() per dot.
+
+static uint8_t readByte(const uint8_t *p, bool progmem)
+{
+  return progmem ? pgm_read_byte(p) : *p;
+}
+
+// Transpose an 8x8 block of dots (Hacker's Delight, 7-3). rows[k] is row k with its leftmost
+// dot in bit 7, columns[i] comes out as the ith column from the left with row k in bit k.
+static void transpose8(const uint8_t rows[8], uint8_t columns[8])
+{
+  // Rows go in bottom first, so each column comes out with the top row in bit 0
+  uint32_t x = ((uint32_t)rows[7] << 24) | ((uint32_t)rows[6] << 16) | ((uint32_t)rows[5] << 8) | rows[4];
+  uint32_t y = ((uint32_t)rows[3] << 24) | ((uint32_t)rows[2] << 16) | ((uint32_t)rows[1] << 8) | rows[0];
+  uint32_t t;
+
+  t = (x ^ (x >> 7)) & 0x00AA00AA;
+  x = x ^ t ^ (t << 7);
+  t = (y ^ (y >> 7)) & 0x00AA00AA;
+  y = y ^ t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000CCCC;
+  x = x ^ t ^ (t << 14);
+  t = (y ^ (y >> 14)) & 0x0000CCCC;
+  y = y ^ t ^ (t << 14);
+  t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+  y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+  x = t;
+
+  columns[0] = x >> 24;
+  columns[1] = x >> 16;
+  columns[2] = x >> 8;
+  columns[3] = x;
+  columns[4] = y >> 24;
+  columns[5] = y >> 16;
+  columns[6] = y >> 8;
+  columns[7] = y;
+}
+
+void mcp::DrawRowBitmap(int16_t x, int16_t y, const uint8_t *bitmap, bool progmem, bool lsbFirst,
+                        int16_t w, int16_t h, uint16_t color, uint16_t bg, bool opaque)
+{
+  // Dots set in the bitmap are drawn in color, the others in bg if opaque, colors as in drawPixel()
+  int16_t byteWidth = (w + 7) / 8;
+  int16_t firstRow = (y < 0) ? -y : 0;
+  int16_t endRow = (h < ySize - y) ? h : ySize - y;
+  int16_t firstByte = (x < 0) ? -x / 8 : 0;
+  int16_t endByte = (byteWidth < (Layout.columns - x + 7) / 8) ? byteWidth : (Layout.columns - x + 7) / 8;
+
+  for (int16_t row = firstRow; row < endRow; row += 8) {
+    int16_t rows = (endRow - row < 8) ? endRow - row : 8;
+    uint16_t mask = (uint16_t)((1 << rows) - 1) << (y + row);
+    for (int16_t b = firstByte; b < endByte; b++) {
+      uint8_t block[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+      for (int16_t k = 0; k < rows; k++) {
+        block[k] = readByte(&bitmap[(row + k) * byteWidth + b], progmem);
+      }
+      uint8_t columns[8];
+      transpose8(block, columns);
+
+      for (int16_t i = 0; i < 8; i++) {
+        int16_t cx = x + b * 8 + i;
+        if (b * 8 + i >= w || cx < 0 || cx >= Layout.columns) {
+          continue;
+        }
+        // XBM keeps its leftmost dot in bit 0 rather than bit 7
+        uint16_t bits = (uint16_t)columns[lsbFirst ? 7 - i : i] << (y + row);
+        uint16_t on = (color == 1) ? bits : 0;
+        uint16_t off = (color == 1) ? 0 : bits;
+        if (opaque) {
+          if (bg == 1) {
+            on |= mask & ~bits;
+          } else {
+            off |= mask & ~bits;
+          }
+        }
+        Framebuffer[cx] = (Framebuffer[cx] & ~off) | on;
+      }
+    }
+  }
+}
+
+void mcp::DrawGrayscale(int16_t x, int16_t y, const uint8_t *bitmap, bool progmem,
+                        int16_t w, int16_t h, uint8_t low, uint8_t high)
+{
+  // One byte per dot, so there is nothing to transpose. Dots from low thru high are on.
+  int16_t firstRow = (y < 0) ? -y : 0;
+  int16_t endRow = (h < ySize - y) ? h : ySize - y;
+  int16_t firstColumn = (x < 0) ? -x : 0;
+  int16_t endColumn = (w < Layout.columns - x) ? w : Layout.columns - x;
+  if (firstRow >= endRow || firstColumn >= endColumn) {
+    return;
+  }
+  uint16_t rows = (uint16_t)((((uint32_t)2 << (endRow - 1 - firstRow)) - 1) << (y + firstRow));
+  FillColumns(x + firstColumn, endColumn - firstColumn, rows, 0);
+  for (int16_t row = firstRow; row < endRow; row++) {
+    uint16_t dot = (uint16_t)1 << (y + row);
+    const uint8_t *from = &bitmap[row * w];
+    for (int16_t i = firstColumn; i < endColumn; i++) {
+      uint8_t value = readByte(&from[i], progmem);
+      if (value >= low && value <= high) {
+        Framebuffer[x + i] |= dot;
+      }
+    }
+  }
+}
+
+void mcp::drawBitmap(int16_t x, int16_t y, const uint8_t bitmap[], int16_t w, int16_t h, uint16_t color)
+{
+  // drawPixel() knows nothing of rotation, so neither do these
+  if (getRotation() != 0) {
+    Adafruit_GFX::drawBitmap(x, y, bitmap, w, h, color);
+    return;
+  }
+  DrawRowBitmap(x, y, bitmap, true, false, w, h, color, 0, false);
+}
+
+void mcp::drawBitmap(int16_t x, int16_t y, const uint8_t bitmap[], int16_t w, int16_t h, uint16_t color,
+                     uint16_t bg)
+{
+  if (getRotation() != 0) {
+    Adafruit_GFX::drawBitmap(x, y, bitmap, w, h, color, bg);
+    return;
+  }
+  DrawRowBitmap(x, y, bitmap, true, false, w, h, color, bg, true);
+}
+
+void mcp::drawBitmap(int16_t x, int16_t y, uint8_t *bitmap, int16_t w, int16_t h, uint16_t color)
+{
+  if (getRotation() != 0) {
+    Adafruit_GFX::drawBitmap(x, y, bitmap, w, h, color);
+    return;
+  }
+  DrawRowBitmap(x, y, bitmap, false, false, w, h, color, 0, false);
+}
+
+void mcp::drawBitmap(int16_t x, int16_t y, uint8_t *bitmap, int16_t w, int16_t h, uint16_t color, uint16_t bg)
+{
+  if (getRotation() != 0) {
+    Adafruit_GFX::drawBitmap(x, y, bitmap, w, h, color, bg);
+    return;
+  }
+  DrawRowBitmap(x, y, bitmap, false, false, w, h, color, bg, true);
+}
+
+void mcp::drawXBitmap(int16_t x, int16_t y, const uint8_t bitmap[], int16_t w, int16_t h, uint16_t color)
+{
+  if (getRotation() != 0) {
+    Adafruit_GFX::drawXBitmap(x, y, bitmap, w, h, color);
+    return;
+  }
+  DrawRowBitmap(x, y, bitmap, true, true, w, h, color, 0, false);
+}
+
+void mcp::drawGrayscaleBitmap(int16_t x, int16_t y, const uint8_t bitmap[], int16_t w, int16_t h)
+{
+  // Each byte is a drawPixel() color, so only 1 turns a dot on
+  if (getRotation() != 0) {
+    Adafruit_GFX::drawGrayscaleBitmap(x, y, bitmap, w, h);
+    return;
+  }
+  DrawGrayscale(x, y, bitmap, true, w, h, 1, 1);
+}
+
+void mcp::drawGrayscaleBitmap(int16_t x, int16_t y, uint8_t *bitmap, int16_t w, int16_t h)
+{
+  if (getRotation() != 0) {
+    Adafruit_GFX::drawGrayscaleBitmap(x, y, bitmap, w, h);
+    return;
+  }
+  DrawGrayscale(x, y, bitmap, false, w, h, 1, 1);
+}
+
+void mcp::drawGrayscaleBitmap(int16_t x, int16_t y, const uint8_t bitmap[], int16_t w, int16_t h,
+                              uint8_t threshold)
+{
+  if (getRotation() != 0) {
+    for (int16_t j = 0; j < h; j++) {
+      for (int16_t i = 0; i < w; i++) {
+        writePixel(x + i, y + j, pgm_read_byte(&bitmap[j * w + i]) >= threshold ? 1 : 0);
+      }
+    }
+    return;
+  }
+  DrawGrayscale(x, y, bitmap, true, w, h, threshold, 0xFF);
+}
+
+void mcp::drawGrayscaleBitmap(int16_t x, int16_t y, uint8_t *bitmap, int16_t w, int16_t h, uint8_t threshold)
+{
+  if (getRotation() != 0) {
+    for (int16_t j = 0; j < h; j++) {
+      for (int16_t i = 0; i < w; i++) {
+        writePixel(x + i, y + j, bitmap[j * w + i] >= threshold ? 1 : 0);
+      }
+    }
+    return;
+  }
+  DrawGrayscale(x, y, bitmap, false, w, h, threshold, 0xFF);
+}
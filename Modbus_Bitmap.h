@@ -0,0 +1,45 @@
+/*
+   Column bitmaps: logos and route graphics kept in flash the way the
+   framebuffer holds them, and compressed.
+
+   Adafruit_GFX's drawBitmap() takes rows of dots and sets them one
+   drawPixel() at a time. An mcpBitmap is stored a column at a time instead,
+   one word per column with the top dot in bit 0, as in the framebuffer, so
+   drawing one is a matter of copying column words. extras/host/flipdot_pack
+   turns a PBM into a header holding one:
+
+     flipdot_pack --bitmap --name logo logo.h logo.pbm
+
+   and the sketch draws it with
+
+     #include "logo.h"
+     mcp.drawColumnBitmap(10, 0, logo); // Or with mcpBlitOr, mcpBlitXor...
+
+   The columns are run length coded, which suits graphics with blank space
+   and bars in them. Each run starts with a count byte:
+
+     0x00 - 0x7F  count + 1 columns follow as they are, 2 bytes each
+     0x80 - 0xFF  one column follows, repeated (count & 0x7F) + 2 times
+
+   and each column is 2 bytes, low byte first, as in the framebuffer.
+   Bitmaps are at most 16 dots tall, the height of the sign.
+*/
+#ifndef Modbus_Bitmap_h
+#define Modbus_Bitmap_h
+
+#include "Arduino.h"
+
+const byte mcpBitmapRun = 0x80;        // Count bytes from this one on start a repeated column
+const int mcpBitmapMaxLiteral = 128;   // Columns in the longest run stored as they are
+const int mcpBitmapMaxRepeat = 129;    // Columns in the longest repeated run
+
+// Made by flipdot_pack --bitmap. The data is in flash (PROGMEM), this struct is not.
+struct mcpBitmap
+{
+  int16_t width;       // Columns
+  byte height;         // Dots, 1 to 16
+  uint16_t size;       // Bytes of data
+  const uint8_t *data; // The runs
+};
+
+#endif
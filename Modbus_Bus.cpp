@@ -0,0 +1,146 @@
+/*
+   Several signs on one RS-485 line, see Modbus_Bus.h
+*/
+#include "Arduino.h"
+#include "Modbus_Bus.h"
+
+mcpBus::mcpBus()
+{
+  NumSigns = 0;
+  Active = 0;
+  Loading = -1;
+  LineFree = 0;
+  NextSign = 0;
+}
+
+bool mcpBus::addSign(mcp &sign)
+{
+  if (NumSigns >= busMaxSigns || Active != 0) {
+    return false;
+  }
+  Signs[NumSigns++] = &sign;
+  return true;
+}
+
+byte mcpBus::getSignCount()
+{
+  return NumSigns;
+}
+
+void mcpBus::UpdateSigns(bool forceFullRefresh)
+{
+  // Let an update that is still running finish first
+  while (isBusy()) {
+    tick();
+    yield();
+  }
+
+  beginUpdate(forceFullRefresh);
+  while (isBusy()) {
+    tick();
+    yield();
+  }
+}
+
+bool mcpBus::beginUpdate(bool forceFullRefresh)
+{
+  // Snapshot every sign's back buffer. Signs already showing their image are left out.
+  // Returns false if an update is already running, or no sign has anything to send.
+  if (Active != 0) {
+    return false;
+  }
+
+  unsigned long now = millis();
+  for (byte i = 0; i < NumSigns; i++) {
+    mcp &sign = *Signs[i];
+    sign.WaitUntilIdle(); // The sign's own asynchronous update must not share its Bytestream
+    if (sign.PrepareUpdate(sign.Framebuffer, forceFullRefresh) != 0) {
+      Active |= 1 << i;
+      Step[i] = 0;
+      Deadline[i] = now;
+    }
+  }
+  Loading = -1;
+  if (Active == 0) {
+    return false;
+  }
+
+  tick(); // Send the first line right away
+  return true;
+}
+
+void mcpBus::tick()
+{
+  // Send at most one line, for the first sign (taking turns) that is ready for one.
+  // Returns immediately if the last line is still on the wire.
+  if (Active == 0) {
+    return;
+  }
+  unsigned long now = millis();
+  if ((long)(now - LineFree) < 0) {
+    return;
+  }
+
+  for (byte n = 0; n < NumSigns; n++) {
+    byte i = (NextSign + n) % NumSigns;
+    if ((Active & (1 << i)) && TickSign(i, now)) {
+      NextSign = i + 1;
+      return;
+    }
+  }
+}
+
+bool mcpBus::TickSign(byte i, unsigned long now)
+{
+  // Advance one sign's update, returns true if it put a line on the wire
+  mcp &sign = *Signs[i];
+  if ((long)(now - Deadline[i]) < 0) {
+    return false;
+  }
+
+  // Skip over registers that do not need sending. The select line has to wait
+  // until no other sign is loading an image.
+  byte stepEndOfData = sign.StepEndOfData();
+  byte stepEndOfUpdate = sign.StepEndOfUpdate();
+  const char *line = NULL;
+  while (Step[i] < stepEndOfUpdate && line == NULL) {
+    if (Step[i] == 0 && Loading >= 0) {
+      return false;
+    }
+    line = sign.UpdateLine(Step[i]++);
+  }
+
+  if (line != NULL) {
+    // Answers on a shared line are counted by whoever sends next, so they cannot be put
+    // down to this sign's registers
+    sign.ReadReplies();
+    unsigned long wireTime = sign.SendLine(line, wireOtherLine);
+    if (Step[i] == 1) {
+      sign.MarkUpdateStart();
+      Loading = i;
+    } else if (Step[i] == stepEndOfData) {
+      Loading = -1; // The end of data record is out, others may load now
+    }
+    LineFree = now + wireTime;
+    Deadline[i] = now + wireTime + sign.LineDelay;
+    return true;
+  }
+
+  if (Step[i] == stepEndOfUpdate) {
+    // All lines are out, wait the end of update delay before calling it done
+    Step[i]++;
+    Deadline[i] = now + sign.EndOfUpdateDelay;
+    if (sign.EndOfUpdateDelay > 0) {
+      return false;
+    }
+  }
+
+  sign.FinishUpdate();
+  Active &= ~(1 << i);
+  return false;
+}
+
+bool mcpBus::isBusy()
+{
+  return Active != 0;
+}
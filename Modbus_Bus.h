@@ -0,0 +1,66 @@
+/*
+   Several signs on one RS-485 line.
+
+   Each sign is an mcpSign with its own sign ID (the command lines are built
+   for that ID at compile time, see Modbus_SignLayout.h), all on the same
+   serial port and baud rate. mcpBus sends their updates together, a line at
+   a time, so the delay one sign needs after a line is spent sending another
+   sign's lines instead of waiting:
+
+     mcpFrontSign front(19200);
+     mcpSign<112, 7> side(19200);
+     mcpSign<28, 8> rear(19200);
+     mcpBus bus;
+
+     bus.addSign(front);
+     bus.addSign(side);
+     bus.addSign(rear);
+     ...draw on each sign...
+     bus.UpdateSigns();
+
+   Image registers carry no sign ID: a sign takes every register sent between
+   its select line and the end of data record (the first commit line). So only
+   one sign at a time may be loading an image, and the others' select, commit
+   and end of update delays are fitted around it. The wire itself is shared,
+   so a bus of full updates still takes as long as all of their bytes do.
+
+   While the bus is sending, leave the signs' own UpdateSign(), beginUpdate()
+   and present() alone. Response pacing is not used on a shared line, each
+   line gets its sign's line delay, and answers are counted by whichever sign
+   sends next.
+*/
+#ifndef Modbus_Bus_h
+#define Modbus_Bus_h
+
+#include "Arduino.h"
+#include "Modbus_CoProcessor.h"
+
+const byte busMaxSigns = 4; // Signs one mcpBus can drive
+
+class mcpBus
+{
+  public:
+    mcpBus();
+    bool addSign(mcp &sign); // False if the bus is full or busy
+    byte getSignCount();
+    // Send every sign's back buffer, blocking until all of them are done
+    void UpdateSigns(bool forceFullRefresh = false);
+    // Asynchronous version: call tick() from loop() until isBusy() is false
+    bool beginUpdate(bool forceFullRefresh = false);
+    void tick();
+    bool isBusy();
+
+  private:
+    bool TickSign(byte i, unsigned long now);
+
+    mcp *Signs[busMaxSigns];
+    byte NumSigns;
+    byte Active; // Signs with an update in progress, one bit per sign
+    byte Step[busMaxSigns]; // Next step of each sign's update, see mcp::UpdateLine()
+    unsigned long Deadline[busMaxSigns]; // millis() at which each sign may take its next line
+    int Loading; // Sign between its select line and its end of data record, -1 for none
+    unsigned long LineFree; // millis() at which the last line has left the port
+    byte NextSign; // Where tick() starts looking, so every sign gets its turn
+};
+
+#endif
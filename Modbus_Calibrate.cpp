@@ -0,0 +1,157 @@
+/*
+   Line delay calibration for the Modbus_CoProcessor library.
+
+   calibrateLineDelay() sends full test frames with less and less delay
+   between lines, and keeps the shortest delay at which the sign still
+   answered every line with an ACK. saveCalibration() and loadCalibration()
+   keep the delays in EEPROM, one record per baud rate, so a sketch can
+   calibrate once and start with the right delay on every boot:
+
+     if (!mcp.loadCalibration() && mcp.calibrateLineDelay() > 0) {
+       mcp.saveCalibration();
+     }
+*/
+#include "Arduino.h"
+#include "Modbus_CoProcessor.h"
+#if MCP_EEPROM
+#include <EEPROM.h>
+#endif
+
+const unsigned int calibrationSettle = 50; // Milliseconds to wait after a test frame for its last answers
+
+#if MCP_EEPROM
+const uint16_t calibrationMagic = 0xF1D0;
+
+// One saved calibration. There are calibrationSlots of these from calibrationEepromAddress.
+struct mcpCalibrationRecord
+{
+  uint16_t magic; // calibrationMagic when the slot is in use
+  uint32_t baudRate;
+  uint8_t lineDelay; // Milliseconds
+  uint8_t endOfUpdateDelay; // Milliseconds
+  uint8_t check; // Sum of the fields above, so a half written record is ignored
+};
+
+static uint8_t recordCheck(const mcpCalibrationRecord &record)
+{
+  // Summed field by field, the padding between them is not ours to read
+  return (uint8_t)(record.magic + (record.magic >> 8) +
+                   record.baudRate + (record.baudRate >> 8) + (record.baudRate >> 16) + (record.baudRate >> 24) +
+                   record.lineDelay + record.endOfUpdateDelay);
+}
+#endif
+
+int mcp::calibrateLineDelay(unsigned int startMs, unsigned int minMs, byte framesPerStep)
+{
+  // Try startMs, then 1ms less each time, until the sign misses or garbles a line.
+  // The answers are counted once each test frame is done, so an answer that is
+  // slow to come back does not count against a delay the sign itself copes with.
+  // Returns the new line delay (calibrationMargin more than the shortest that worked),
+  // or -1 with the line delay unchanged if not even startMs worked.
+  WaitUntilIdle(); // Let an asynchronous update finish first
+  bool pacing = ResponsePacing;
+  unsigned int lineDelay = LineDelay;
+  ResponsePacing = false; // Every line gets exactly the delay being tested
+
+  int shortest = -1;
+  for (int ms = startMs; ms >= (int)minMs; ms--) {
+    LineDelay = ms;
+    bool accepted = true;
+    for (byte frame = 0; frame < framesPerStep && accepted; frame++) {
+      accepted = CalibrationFrameAccepted(frame & 1);
+    }
+    if (!accepted) {
+      break;
+    }
+    shortest = ms;
+  }
+
+  ResponsePacing = pacing;
+  if (shortest < 0) {
+    LineDelay = lineDelay;
+    SentBytestreamValid = false; // Who knows what the sign made of the test frame
+    return -1;
+  }
+
+  LineDelay = shortest + calibrationMargin;
+  if (LineDelay > startMs) {
+    LineDelay = startMs;
+  }
+
+  // The sign may have missed lines of the last test frame, leave it blank and in step
+  dotAllOff();
+  UpdateSign(true);
+  return LineDelay;
+}
+
+bool mcp::CalibrationFrameAccepted(bool invert)
+{
+  // Send a checkerboard as a full refresh, then check every line got an ACK
+  for (int x = 0; x < Layout.columns; x++) {
+    Framebuffer[x] = ((x & 1) ^ invert) ? 0xAAAA : 0x5555;
+  }
+
+  ReadReplies(); // Count anything left over before taking the snapshot
+  mcpLinkStats before = LinkStats;
+  UpdateSign(true);
+  delay(calibrationSettle);
+  ReadReplies();
+
+  unsigned long lines = 1 + Layout.numRegisters + Layout.numCommitLines; // Select, registers, commit
+  return LinkStats.acks - before.acks == lines &&
+         LinkStats.naks == before.naks &&
+         LinkStats.badLrc == before.badLrc;
+}
+
+bool mcp::saveCalibration()
+{
+  // Replaces the record for this baud rate, or takes an empty slot, or the last one
+#if MCP_EEPROM
+  if (LineDelay > 255 || EndOfUpdateDelay > 255) {
+    return false;
+  }
+  mcpCalibrationRecord record;
+  record.magic = calibrationMagic;
+  record.baudRate = BaudRate;
+  record.lineDelay = LineDelay;
+  record.endOfUpdateDelay = EndOfUpdateDelay;
+  record.check = recordCheck(record);
+
+  int found = -1;
+  int empty = -1;
+  for (byte slot = 0; slot < calibrationSlots; slot++) {
+    mcpCalibrationRecord saved;
+    EEPROM.get(calibrationEepromAddress + slot * sizeof(saved), saved);
+    bool valid = saved.magic == calibrationMagic && saved.check == recordCheck(saved);
+    if (valid && saved.baudRate == BaudRate) {
+      found = slot;
+      break;
+    }
+    if (!valid && empty < 0) {
+      empty = slot;
+    }
+  }
+  int slot = (found >= 0) ? found : (empty >= 0) ? empty : calibrationSlots - 1;
+  EEPROM.put(calibrationEepromAddress + slot * sizeof(record), record);
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool mcp::loadCalibration()
+{
+  // Look for a record saved at this baud rate
+#if MCP_EEPROM
+  for (byte slot = 0; slot < calibrationSlots; slot++) {
+    mcpCalibrationRecord saved;
+    EEPROM.get(calibrationEepromAddress + slot * sizeof(saved), saved);
+    if (saved.magic == calibrationMagic && saved.check == recordCheck(saved) && saved.baudRate == BaudRate) {
+      LineDelay = saved.lineDelay;
+      EndOfUpdateDelay = saved.endOfUpdateDelay;
+      return true;
+    }
+  }
+#endif
+  return false;
+}
@@ -20,19 +20,118 @@
 #include "Modbus_CoProcessor.h"
 #include <Adafruit_GFX.h>
 
-mcp::mcp(int baudRate) : Adafruit_GFX(xSize, ySize)
+// Fixed header at the start of register 0
+static const byte imageHeader[mcpImageHeaderSize] = {0x01, 0x0A, 0x00, 0x00};
+
+// Every update is sent as these steps, one line each:
+// the select line, the image registers, the commit lines, then the end of update delay.
+// The register map and command lines come from the sign's mcpLayout.
+const byte stepFirstRegister = 1;
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+// Phase timing helpers, these compile to nothing when MCP_PROFILE is 0
+#if MCP_PROFILE
+#define PROFILE_MARK(start) unsigned long start = MCP_PROFILE_MICROS()
+#define PROFILE_SINCE(field, start) Profile.field += MCP_PROFILE_MICROS() - start
+#define PROFILE_COUNT(field, n) Profile.field += (n)
+#define PROFILE_MAX(field, start) \
+  do { \
+    unsigned long elapsed = MCP_PROFILE_MICROS() - start; \
+    if (elapsed > Profile.field) Profile.field = elapsed; \
+  } while (0)
+#else
+#define PROFILE_MARK(start)
+#define PROFILE_SINCE(field, start)
+#define PROFILE_COUNT(field, n)
+#define PROFILE_MAX(field, start)
+#endif
+
+// Write one byte as two hex digits, and add it to the running LRC
+static inline char *appendHexByte(char *out, byte value, byte &lrc)
 {
-  // These items are ran when the class is instantiated.
-  SERIALDEVICE.begin(baudRate);
+  *out++ = hexDigits[value >> 4];
+  *out++ = hexDigits[value & 0x0F];
+  lrc += value;
+  return out;
+}
 
-  // Init the human readable bitmap with 0s
+// Write n zero bytes, which never change the LRC
+static inline char *appendZeros(char *out, byte n)
+{
+  for (byte i = 0; i < n; i++) {
+    *out++ = '0';
+    *out++ = '0';
+  }
+  return out;
+}
+
+mcp::mcp(int baudRate, mcpTransport &transport, const mcpLayout &layout, uint16_t *backBuffer,
+         uint16_t *frontBuffer, byte *bytestream, byte *sentBytestream, mcpLineCacheSet *lineCache)
+  : Adafruit_GFX(layout.columns, ySize), Layout(layout), Transport(transport)
+{
+  // These items are ran when the class is instantiated.
+  // The buffers belong to mcpSign, sized for this sign.
+  BaudRate = baudRate;
+  Bytestream = bytestream;
+  SentBytestream = sentBytestream;
+  Transport.begin(baudRate);
+
+  // No asynchronous update in progress
+  UpdateRegisters = 0;
+  UpdatePack = NULL;
+  PackShown = NULL;
+  UpdateStep = 0;
+  AheadLine = NULL;
+  AheadWire = wireOtherLine;
+  WireLine = wireOtherLine;
+  FailedRegisters = 0;
+  UpdateBusy = false;
+  UpdateDeadline = 0;
+  UpdateCompleteCallback = NULL;
+
+  // Fixed delay after each line until setResponsePacing() is called
+  LineDelay = eolDelay;
+  EndOfUpdateDelay = endOfUpdateDelay;
+  SettleTime = settleTime;
+  SettledAt = millis();
+  ResponsePacing = false;
+  ResponseTimeout = eolDelay;
+  AwaitingReply = false;
+  ReplyDigits = -1;
+  resetLinkStats();
+
+  // Init both framebuffers with 0s
+  Framebuffer = backBuffer;
+  FrontBuffer = frontBuffer;
   dotAllOff();
+  memcpy(FrontBuffer, Framebuffer, Layout.columns * sizeof(uint16_t));
+  FramePending = false;
+  PendingFullRefresh = false;
+  FramesPresented = 0;
+  FramesSent = 0;
+  FramesCoalesced = 0;
+  resetProfile();
+#if MCP_PROFILE
+  UpdateStartMicros = 0;
+#endif
 
   // Init the byte array with 0s
-  for (int i = 0; i < byteStreamSize; i++) {
+  for (int i = 0; i < Layout.byteStreamSize; i++) {
     Bytestream[i] = 0;
+    SentBytestream[i] = 0;
   }
 
+  // We have no idea what the sign is showing yet, so the first update sends everything
+  SentBytestreamValid = false;
+
+  // Nothing encoded yet
+  LineCache = lineCache;
+#if MCP_LINE_CACHE
+  memset(LineCache, 0, Layout.numRegisters * sizeof(mcpLineCacheSet));
+#endif
+  resetLineCacheStats();
+
 }
 
 void mcp::drawPixel(int16_t x, int16_t y, uint16_t color) {
@@ -51,572 +150,1033 @@ void mcp::drawPixel(int16_t x, int16_t y, uint16_t color) {
   }
 }
 
+bool mcp::getPixel(int16_t x, int16_t y)
+{
+  // Read back a dot from the back buffer (what has been drawn so far)
+  if ((x < 0) || (x >= width()) || (y < 0) || (y >= height()))
+    return false;
+
+  return (Framebuffer[x] >> y) & 1;
+}
+
 void mcp::dotOn(byte x, byte y)
 {
   // Generally you will want to use the Adafruit_GFX library, however
   // you can directly call "dotOn" if you want. There is no OOB checking.
-  BitmapMatrix[x][y] = 1;
+  Framebuffer[x] |= (uint16_t)1 << y;
 }
 
 void mcp::dotOff(byte x, byte y)
 {
   // Generally you will want to use the Adafruit_GFX library, however
   // you can directly call "dotOff" if you want. There is no OOB checking.
-  BitmapMatrix[x][y] = 0;
+  Framebuffer[x] &= ~((uint16_t)1 << y);
 }
 
 void mcp::dotAllOn()
 {
-  // Init the 2D array with all 1s
-  for (int x = 0; x < xSize; x++) {
-    for (int y = 0; y < ySize; y++) {
-      BitmapMatrix[x][y] = 1;
-    }// close for x
-  }// close for y
+  // Set every column word to all 1s
+  memset(Framebuffer, 0xFF, Layout.columns * sizeof(uint16_t));
 }
 
 void mcp::dotAllOff()
 {
-  // Init the 2D array with all 0s
-  for (int x = 0; x < xSize; x++) {
-    for (int y = 0; y < ySize; y++) {
-      BitmapMatrix[x][y] = 0;
-    }// close for x
-  }// close for y
+  // Set every column word to all 0s
+  memset(Framebuffer, 0, Layout.columns * sizeof(uint16_t));
 }
 
 void mcp::invertAll()
 {
-  // Invert all dots
-  for (int x = 0; x < xSize; x++) {
-    for (int y = 0; y < ySize; y++) {
-      if (BitmapMatrix[x][y] == 0) {
-        BitmapMatrix[x][y] = 1;
-      } else {
-        BitmapMatrix[x][y] = 0;
+  // Invert all dots, a whole column at a time
+  for (int x = 0; x < Layout.columns; x++) {
+    Framebuffer[x] ^= 0xFFFF;
+  }
+}
+
+void mcp::drawColumns(int16_t x, const uint16_t *columns, int16_t count, mcpBlitMode mode)
+{
+  // Used by mcpStrip to blit a window of pre-rendered columns, see Modbus_Scroller.h
+  if (x < 0) {
+    columns -= x;
+    count += x;
+    x = 0;
+  }
+  if (count > Layout.columns - x) {
+    count = Layout.columns - x;
+  }
+  if (count <= 0) {
+    return;
+  }
+  uint16_t *to = &Framebuffer[x];
+  switch (mode) {
+    case mcpBlitCopy:
+      memcpy(to, columns, count * sizeof(uint16_t));
+      break;
+    case mcpBlitOr:
+      for (int16_t i = 0; i < count; i++) {
+        to[i] |= columns[i];
+      }
+      break;
+    case mcpBlitAnd:
+      for (int16_t i = 0; i < count; i++) {
+        to[i] &= columns[i];
       }
-    }// close for x
-  }// close for y
+      break;
+    case mcpBlitXor:
+      for (int16_t i = 0; i < count; i++) {
+        to[i] ^= columns[i];
+      }
+      break;
+  }
+}
+
+const uint16_t *mcp::getColumns()
+{
+  return Framebuffer;
+}
+
+// Dots y0 thru y1 of a column, either way round and clipped to the sign, the same dots
+// Adafruit_GFX's line from y0 to y1 would draw
+static uint16_t spanMask(int16_t y0, int16_t y1)
+{
+  if (y0 > y1) {
+    int16_t swap = y0;
+    y0 = y1;
+    y1 = swap;
+  }
+  if (y0 < 0) {
+    y0 = 0;
+  }
+  if (y1 >= ySize) {
+    y1 = ySize - 1;
+  }
+  if (y0 > y1) {
+    return 0;
+  }
+  return (uint16_t)((((uint32_t)2 << (y1 - y0)) - 1) << y0);
+}
+
+void mcp::FillColumns(int16_t x, int16_t w, uint16_t mask, uint16_t color)
+{
+  // Turn the dots in mask on (color 1, as in drawPixel()) or off in columns x thru x + w - 1
+  if (x < 0) {
+    w += x;
+    x = 0;
+  }
+  if (w > Layout.columns - x) {
+    w = Layout.columns - x;
+  }
+  if (mask == 0 || w <= 0) {
+    return;
+  }
+  uint16_t *column = &Framebuffer[x];
+  if (color == 1) {
+    for (int16_t i = 0; i < w; i++) {
+      column[i] |= mask;
+    }
+  } else {
+    mask = ~mask;
+    for (int16_t i = 0; i < w; i++) {
+      column[i] &= mask;
+    }
+  }
+}
+
+void mcp::drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color)
+{
+  // drawPixel() knows nothing of rotation, so neither does this
+  if (getRotation() != 0) {
+    Adafruit_GFX::drawFastVLine(x, y, h, color);
+    return;
+  }
+  FillColumns(x, 1, spanMask(y, y + h - 1), color);
+}
+
+void mcp::drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color)
+{
+  if (getRotation() != 0) {
+    Adafruit_GFX::drawFastHLine(x, y, w, color);
+    return;
+  }
+  if (w <= 0) {
+    // Adafruit_GFX draws the line from x to x + w - 1, which includes both ends
+    x += w - 1;
+    w = 2 - w;
+  }
+  FillColumns(x, w, spanMask(y, y), color);
+}
+
+void mcp::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+  // Every column of the rectangle gets the same mask
+  if (getRotation() != 0) {
+    Adafruit_GFX::fillRect(x, y, w, h, color);
+    return;
+  }
+  if (w > 0) {
+    FillColumns(x, w, spanMask(y, y + h - 1), color);
+  }
 }
 
+void mcp::fillScreen(uint16_t color)
+{
+  if (color == 1) {
+    dotAllOn();
+  } else {
+    dotAllOff();
+  }
+}
 
-void mcp::UpdateSign()
+void mcp::UpdateSign(bool forceFullRefresh)
 {
-  // This will take everything in the human bitmap,
+  // This will take everything in the framebuffer,
   // Convert it to the correct ordering and stream of bytes
   // Then print those bytes out as ASCII, with checksum, to serial
   // Essentially, this tells the sign to display what you have
   // written to the bitmap array with dotOn()/dotOff()
 
-  // This command is blocking and takes about 615ms to run on a 96MHz MCU
-  // ~400ms of calculations + serial writing, and ~200ms of required EOL delays
+  // Only the registers that changed since the last update are sent.
+  // Pass true to resend every register, e.g. if the sign may have been power cycled.
 
-  // Convert bitmap to correct stream of bytes
-  ConvertBitmapToBytestream();
-
-  // Tell sign we are about to send a new image
-  PrintString(":01000603A254");
-
-  // Print computed registers 0 thru E
-  // These registers contain the sign image data
-  PrintRegister0();
-  PrintRegister1();
-  PrintRegister2();
-  PrintRegister3();
-  PrintRegister4();
-  PrintRegister5();
-  PrintRegister6();
-  PrintRegister7();
-  PrintRegister8();
-  PrintRegister9();
-  PrintRegisterA();
-  PrintRegisterB();
-  PrintRegisterC();
-  PrintRegisterD();
-  PrintRegisterE();
-
-  // Tell the sign to display the image!
-  PrintString(":00000F01F0");
-  PrintString(":0100060200F7");
-  PrintString(":0100060600F3");
-  PrintString(":0100060200F7");
-  PrintString(":01000603A94D");
-
-  delay(endOfUpdateDelay); // This delay is 0 by default
+  // A full update is blocking and takes about 615ms to run on a 96MHz MCU
+  // ~400ms of register encoding + serial writing, and ~200ms of required EOL delays
+  // Each register that does not need sending saves a line and its EOL delay.
+  // See beginUpdate() for a version that does not block.
+
+  // Let an asynchronous update that is still running finish first
+  WaitUntilIdle();
+
+  PROFILE_MARK(updateStart);
+  if (PrepareUpdate(Framebuffer, forceFullRefresh) == 0) {
+    return; // The sign is already showing this image
+  }
+
+  SendPrepared();
+  PROFILE_SINCE(updateMicros, updateStart);
 }
 
-void mcp::ConvertBitmapToBytestream()
+void mcp::SendPrepared()
 {
-  int byteStreamCounter = 0;
-  for (int x = 0; x < xSize; x++) { // Loop thru each column
-
-    for (int y1 = 7; y1 > -1; y1--) { // Loop thru the first 8 bits of a column
-      if (BitmapMatrix[x][y1] == 1) {
-        bitSet(Bytestream[byteStreamCounter], 0); // Set bit to a 1 in the right most place of the byte
-      } else {
-        bitClear(Bytestream[byteStreamCounter], 0); // Set bit to a 0 in the right most place of the byte
-      }
-      if (y1 > 0) { // This if prevents the bitshift << from happening more than 7 times
-        Bytestream[byteStreamCounter] <<= 1; // Because bitSet and bitClear write to the LSB (right most) bit,
-        //bump all the bits over to the left one position to prepare the LSB for next set or clear
-      }
-    }// close for first 8 bits of a column
-    byteStreamCounter++;
+  // Send the update PrepareUpdate() or PreparePackFrame() set up, blocking.
+  // Each line is encoded while the one before it is still on the wire.
+  UpdateStep = 0;
+  SettledAt = millis() + (estimateUpdateMicros(UpdateRegisters) + 999) / 1000 + SettleTime;
+  MarkUpdateStart();
+  const char *line = NextLine();
+  while (line != NULL) {
+    WriteLine(line, StepWire(UpdateStep - 1));
+    line = NextLine();
+    WaitLineGap();
+  }
 
-    for (int y2 = 15; y2 > 7; y2--) { // Loop thru the second 8 bits of a column
-      if (BitmapMatrix[x][y2] == 1) {
-        bitSet(Bytestream[byteStreamCounter], 0); // Set bit to a 1
-      } else {
-        bitClear(Bytestream[byteStreamCounter], 0); // Set bit to a 0
-      }
-      if (y2 > 8) { // This if prevents the bitshift << from happening more than 7 times
-        Bytestream[byteStreamCounter] <<= 1;
-      }
-    }// close for second 8 bits of a column
-    byteStreamCounter++;
-  }// close for x
+  PROFILE_MARK(delayStart);
+  delay(EndOfUpdateDelay); // This delay is 0 by default
+  PROFILE_SINCE(eolMicros, delayStart);
+  FinishUpdate();
 }
 
-void mcp::InitSign()
+void mcp::updateRegion(int16_t x0, int16_t y0, int16_t x1, int16_t y1)
 {
-  // This must be run once after the sign is physically powered on.
-  // This command puts the sign into "ready" mode, where it waits for new data.
-  // Note that this is hardcoded to sign ID 6, also checksums are hardcoded.
-  PrintString(":01000502FFF9");
-  PrintString(":01000602FFF8");
-  PrintString(":01000603A155");
-  PrintString(":100000000447000F101C1C1C1C1000000000000006");
-  PrintString(":00000101FE");
-  PrintString(":0100060200F7");
+  // For apps that know what they drew, e.g. a flashing colon or one digit of a route number.
+  // Registers outside the region are left as they are on the sign, even if they changed,
+  // and the next UpdateSign() sends them.
+  (void)y0;
+  (void)y1;
+  updateRegisters(getRegionRegisters(x0, x1));
 }
 
-void mcp::CloseSign()
+bool mcp::beginUpdateRegion(int16_t x0, int16_t y0, int16_t x1, int16_t y1)
 {
-  // This can be run before 24v power is shutdown to the sign.
-  // This command will fully clear the sign, writing a hard flip off to each dot.
-  // Note that this is hardcoded to sign ID 6, also checksums are hardcoded.
-  // The sign generally needs to be power cycled after you shut it down with this command.
-  // Also note, if the 12v power alone is removed from the sign, the sign will initiate
-  // this same shutdown code on its own.
-  PrintString(":01000603A94D");
-  PrintString(":01000603AA4C");
-  PrintString(":01007F02FF7F");
-  PrintString(":0100060255A2");
-  PrintString(":01000603A650");
+  (void)y0;
+  (void)y1;
+  return beginUpdateRegisters(getRegionRegisters(x0, x1));
 }
 
-void mcp::PrintString(String in)
+void mcp::updateRegisters(uint16_t registers)
 {
-  // This will write data to the serial device that is hooked to RS485
-  // In case the sign is talking to us, wait for it to finish
-  while (SERIALDEVICE.available() > 0) {
-    SERIALDEVICE.read(); // Throw away everything the sign says, we don't care.
+  WaitUntilIdle();
+
+  PROFILE_MARK(updateStart);
+  if (PrepareRegisters(registers) == 0) {
+    return; // None on the sign, e.g. a region off its edge
   }
 
-  SERIALDEVICE.println(in); // println default EOL is CRLF, good for modbus
-  SERIALDEVICE.flush(); // Wait for the serial port to finish sending
-  delay(eolDelay); // Delay in ms after each line is sent
+  SendPrepared();
+  PROFILE_SINCE(updateMicros, updateStart);
+}
 
-  // In case the sign is responding, wait for it to finish
-  while (SERIALDEVICE.available() > 0) {
-    SERIALDEVICE.read(); // Throw away everything the sign says, we don't care.
+bool mcp::beginUpdateRegisters(uint16_t registers)
+{
+  if (UpdateBusy || PrepareRegisters(registers) == 0) {
+    return false;
   }
+
+  StartSending();
+  return true;
 }
 
-void mcp::PrintRegister0()
+uint16_t mcp::getRegionRegisters(int16_t x0, int16_t x1)
 {
-  // Loop thru correct number of bytes for this register
-  // Concat any before/after text
-  // Call calculate checksum
-  // Print final String
-
-  int startingPoint = 0; // R0 starts at byte 0
-  int numOfBytesToChewOff = 12; // R0 needs 12 bytes of data
-  String prependData = ""; // Per-register string to start with
-  String middleData = "";
-  String checksum = ""; // Per-register checksum to be calculated
+  // Column x is Bytestream bytes 2x and 2x + 1, which are always in the same register
+  if (x0 > x1) {
+    int16_t swap = x0;
+    x0 = x1;
+    x1 = swap;
+  }
+  if (x0 < 0) {
+    x0 = 0;
+  }
+  if (x1 >= Layout.columns) {
+    x1 = Layout.columns - 1;
+  }
 
-  prependData = ":10000000010A0000";
+  uint16_t registers = 0;
+  for (byte reg = 0; reg < Layout.numRegisters && x0 <= x1; reg++) {
+    const mcpRegister &r = Layout.registers[reg];
+    if (r.count > 0 && r.start < 2 * (x1 + 1) && r.start + r.count > 2 * x0) {
+      registers |= (uint16_t)1 << reg;
+    }
+  }
+  return registers;
+}
 
-  for (int i = startingPoint; i < startingPoint + numOfBytesToChewOff; i++) {
-    char sBuffer [4];
-    sprintf(sBuffer, "%0.2X", Bytestream[i]);
-    middleData.concat(sBuffer[0]);
-    middleData.concat(sBuffer[1]);
+bool mcp::beginUpdate(bool forceFullRefresh)
+{
+  // Start sending the current framebuffer without blocking.
+  // The image is copied to Bytestream now, so drawing can carry on straight away.
+  // Returns false if an update is already running, or there is nothing to send.
+  if (UpdateBusy) {
+    return false;
   }
 
-  checksum = calculateLRC(prependData + middleData);
-  PrintString(prependData + middleData + checksum);
+  return StartUpdate(Framebuffer, forceFullRefresh);
 }
 
-void mcp::PrintRegister1()
+void mcp::present(bool forceFullRefresh)
 {
-  // Loop thru correct number of bytes for this register
-  // Concat any before/after text
-  // Call calculate checksum
-  // Print final String
+  // Publish the back buffer as the next frame to send, without blocking.
+  // If an update is running the frame waits until it is done. If another frame
+  // is already waiting, it is replaced by this one and never sent (coalesced).
+  FramesPresented++;
+  if (FramePending) {
+    FramesCoalesced++;
+  }
 
-  int startingPoint = 12; // R1 starts at byte 12
-  int numOfBytesToChewOff = 16; // R1 needs 16 bytes of data
-  String prependData = ""; // Per-register string to start with
-  String middleData = "";
-  String checksum = ""; // Per-register checksum to be calculated
+  // Swap the buffers, then carry the image over so drawing continues from this frame
+  uint16_t *presented = Framebuffer;
+  Framebuffer = FrontBuffer;
+  FrontBuffer = presented;
+  memcpy(Framebuffer, FrontBuffer, Layout.columns * sizeof(uint16_t));
 
-  prependData = ":10001000";
+  PendingFullRefresh = PendingFullRefresh || forceFullRefresh;
+  FramePending = true;
 
-  for (int i = startingPoint; i < startingPoint + numOfBytesToChewOff; i++) {
-    char sBuffer [4];
-    sprintf(sBuffer, "%0.2X", Bytestream[i]);
-    middleData.concat(sBuffer[0]);
-    middleData.concat(sBuffer[1]);
+  if (!UpdateBusy) {
+    FramePending = false;
+    StartUpdate(FrontBuffer, PendingFullRefresh);
+    PendingFullRefresh = false;
   }
+}
 
-  checksum = calculateLRC(prependData + middleData);
-  PrintString(prependData + middleData + checksum);
+unsigned long mcp::getFramesPresented()
+{
+  return FramesPresented;
 }
 
-void mcp::PrintRegister2()
+unsigned long mcp::getFramesSent()
 {
-  // This register is left totally blank, because I have 98x16 sign.
-  // The 98x16 sign has a chunk of dots missing, so we will just send blank
-  // to the sign controller, and it will make the image seamless.
-  PrintString(":1000200000000000000000000000000000000000D0");
+  // Updates that actually went out, from UpdateSign(), beginUpdate() or present()
+  return FramesSent;
 }
 
-void mcp::PrintRegister3()
+unsigned long mcp::getFramesCoalesced()
 {
-  // Loop thru correct number of bytes for this register
-  // Concat any before/after text
-  // Call calculate checksum
-  // Print final String
+  return FramesCoalesced;
+}
 
-  // R3 is still making up for the blank section
+mcpProfile mcp::getProfile()
+{
+  // Phase timing and counters since the last resetProfile(), all zeros if MCP_PROFILE is 0
+#if MCP_PROFILE
+  return Profile;
+#else
+  static const mcpProfile none = {};
+  return none;
+#endif
+}
 
-  int startingPoint = 28; // R3 starts at byte 28
-  int numOfBytesToChewOff = 4; // R3 needs 4 bytes of data
-  String prependData = ""; // Per-register string to start with
-  String middleData = "";
-  String checksum = ""; // Per-register checksum to be calculated
+void mcp::resetProfile()
+{
+#if MCP_PROFILE
+  memset(&Profile, 0, sizeof(Profile));
+#endif
+}
 
-  prependData = ":10003000000000000000000000000000";
+void mcp::MarkUpdateStart()
+{
+  // For worstUpdateMicros, see FinishUpdate()
+#if MCP_PROFILE
+  UpdateStartMicros = MCP_PROFILE_MICROS();
+#endif
+}
 
-  for (int i = startingPoint; i < startingPoint + numOfBytesToChewOff; i++) {
-    char sBuffer [4];
-    sprintf(sBuffer, "%0.2X", Bytestream[i]);
-    middleData.concat(sBuffer[0]);
-    middleData.concat(sBuffer[1]);
-  }
+static void printStat(Print &out, const __FlashStringHelper *name, unsigned long value)
+{
+  out.print(name);
+  out.print(' ');
+  out.println(value);
+}
 
-  checksum = calculateLRC(prependData + middleData);
-  PrintString(prependData + middleData + checksum);
+void mcp::printStats(Print &out)
+{
+  printStat(out, F("framesPresented"), FramesPresented);
+  printStat(out, F("framesSent"), FramesSent);
+  printStat(out, F("framesCoalesced"), FramesCoalesced);
+  printStat(out, F("acks"), LinkStats.acks);
+  printStat(out, F("naks"), LinkStats.naks);
+  printStat(out, F("badLrc"), LinkStats.badLrc);
+  printStat(out, F("timeouts"), LinkStats.timeouts);
+  printStat(out, F("lineCacheHits"), LineCacheStats.hits);
+  printStat(out, F("lineCacheMisses"), LineCacheStats.misses);
+#if MCP_PROFILE
+  printStat(out, F("updates"), Profile.updates);
+  printStat(out, F("lines"), Profile.lines);
+  printStat(out, F("bytes"), Profile.bytes);
+  printStat(out, F("registersSent"), Profile.registersSent);
+  printStat(out, F("registersSkipped"), Profile.registersSkipped);
+  printStat(out, F("convertMicros"), Profile.convertMicros);
+  printStat(out, F("encodeMicros"), Profile.encodeMicros);
+  printStat(out, F("writeMicros"), Profile.writeMicros);
+  printStat(out, F("flushMicros"), Profile.flushMicros);
+  printStat(out, F("eolMicros"), Profile.eolMicros);
+  printStat(out, F("updateMicros"), Profile.updateMicros);
+  printStat(out, F("worstUpdateMicros"), Profile.worstUpdateMicros);
+  printStat(out, F("replyBytes"), Profile.replyBytes);
+  printStat(out, F("discardedBytes"), Profile.discardedBytes);
+#endif
 }
 
-void mcp::PrintRegister4()
+void mcp::setResponsePacing(bool enabled, unsigned int timeoutMs)
 {
-  // Loop thru correct number of bytes for this register
-  // Concat any before/after text
-  // Call calculate checksum
-  // Print final String
+  // Takes effect from the next line sent
+  ResponsePacing = enabled;
+  ResponseTimeout = timeoutMs;
+}
 
-  int startingPoint = 32;
-  int numOfBytesToChewOff = 16;
-  String prependData = ""; // Per-register string to start with
-  String middleData = "";
-  String checksum = ""; // Per-register checksum to be calculated
+mcpLineCacheStats mcp::getLineCacheStats()
+{
+  // Counted since the last resetLineCacheStats(), all misses if MCP_LINE_CACHE is 0
+  return LineCacheStats;
+}
 
-  prependData = ":10004000";
+void mcp::resetLineCacheStats()
+{
+  memset(&LineCacheStats, 0, sizeof(LineCacheStats));
+}
 
-  for (int i = startingPoint; i < startingPoint + numOfBytesToChewOff; i++) {
-    char sBuffer [4];
-    sprintf(sBuffer, "%0.2X", Bytestream[i]);
-    middleData.concat(sBuffer[0]);
-    middleData.concat(sBuffer[1]);
-  }
+void mcp::setLineDelay(unsigned int ms)
+{
+  // Takes effect from the next line sent, see calibrateLineDelay() to find a good value
+  LineDelay = ms;
+}
 
-  checksum = calculateLRC(prependData + middleData);
-  PrintString(prependData + middleData + checksum);
+unsigned int mcp::getLineDelay()
+{
+  return LineDelay;
 }
 
-void mcp::PrintRegister5()
+void mcp::setEndOfUpdateDelay(unsigned int ms)
 {
-  // Loop thru correct number of bytes for this register
-  // Concat any before/after text
-  // Call calculate checksum
-  // Print final String
+  EndOfUpdateDelay = ms;
+}
 
-  int startingPoint = 48;
-  int numOfBytesToChewOff = 16;
-  String prependData = ""; // Per-register string to start with
-  String middleData = "";
-  String checksum = ""; // Per-register checksum to be calculated
+unsigned int mcp::getEndOfUpdateDelay()
+{
+  return EndOfUpdateDelay;
+}
 
-  prependData = ":10005000";
+mcpLinkStats mcp::getLinkStats()
+{
+  // Answers counted since the last resetLinkStats(), whether response pacing is on or not
+  return LinkStats;
+}
+
+void mcp::resetLinkStats()
+{
+  memset(&LinkStats, 0, sizeof(LinkStats));
+}
 
-  for (int i = startingPoint; i < startingPoint + numOfBytesToChewOff; i++) {
-    char sBuffer [4];
-    sprintf(sBuffer, "%0.2X", Bytestream[i]);
-    middleData.concat(sBuffer[0]);
-    middleData.concat(sBuffer[1]);
+bool mcp::StartUpdate(const uint16_t *columns, bool forceFullRefresh)
+{
+  // Start sending an image asynchronously, returns false if it is already on the sign
+  if (PrepareUpdate(columns, forceFullRefresh) == 0) {
+    return false;
   }
 
-  checksum = calculateLRC(prependData + middleData);
-  PrintString(prependData + middleData + checksum);
+  StartSending();
+  return true;
 }
 
-void mcp::PrintRegister6()
+void mcp::StartSending()
 {
-  // Loop thru correct number of bytes for this register
-  // Concat any before/after text
-  // Call calculate checksum
-  // Print final String
+  // Start sending the update PrepareUpdate() or PreparePackFrame() set up
+  UpdateStep = 0;
+  AheadLine = NULL;
+  UpdateDeadline = millis();
+  SettledAt = UpdateDeadline + (estimateUpdateMicros(UpdateRegisters) + 999) / 1000 + SettleTime;
+  MarkUpdateStart();
+  UpdateBusy = true;
+  tick(); // Send the first line right away
+}
 
-  int startingPoint = 64;
-  int numOfBytesToChewOff = 16;
-  String prependData = ""; // Per-register string to start with
-  String middleData = "";
-  String checksum = ""; // Per-register checksum to be calculated
+void mcp::tick()
+{
+  // Advance an asynchronous update by at most one line.
+  // Call this often from loop(), it returns immediately if it is not time yet.
+  if (!UpdateBusy) {
+    return;
+  }
+  if (AwaitingReply) {
+    // Go on as soon as the sign answers the last line, or once the timeout is up
+    if (ReadReply()) {
+      AwaitingReply = false;
+    } else if ((long)(millis() - UpdateDeadline) >= 0) {
+      AwaitingReply = false;
+      LinkStats.timeouts++;
+      LineFailed();
+    } else {
+      return;
+    }
+  } else if ((long)(millis() - UpdateDeadline) < 0) {
+    return;
+  }
 
-  prependData = ":10006000";
+  // The line encoded ahead by the last tick(), if there is one
+  byte stepEndOfUpdate = StepEndOfUpdate();
+  const char *line = AheadLine;
+  byte wire = AheadWire;
+  if (line == NULL) {
+    line = NextLine();
+    wire = StepWire(UpdateStep - 1);
+  }
+  AheadLine = NULL;
+
+  if (line != NULL) {
+    // The next line may go once this one has left the port, plus the usual EOL delay
+    unsigned long wireTime = SendLine(line, wire);
+    if (ResponsePacing) {
+      // Now wait for the answer, see the top of tick()
+      AwaitingReply = true;
+      ReplyDigits = -1;
+      UpdateDeadline = millis() + wireTime + ((ResponseTimeout < LineDelay) ? LineDelay : ResponseTimeout);
+    } else {
+      UpdateDeadline = millis() + wireTime + LineDelay;
+    }
+    AheadLine = NextLine(); // Encode the next line while this one is on the wire
+    AheadWire = StepWire(UpdateStep - 1);
+    return;
+  }
 
-  for (int i = startingPoint; i < startingPoint + numOfBytesToChewOff; i++) {
-    char sBuffer [4];
-    sprintf(sBuffer, "%0.2X", Bytestream[i]);
-    middleData.concat(sBuffer[0]);
-    middleData.concat(sBuffer[1]);
+  if (UpdateStep == stepEndOfUpdate) {
+    // All lines are out, wait the end of update delay before calling it done
+    UpdateStep++;
+    UpdateDeadline = millis() + EndOfUpdateDelay;
+    if (EndOfUpdateDelay > 0) {
+      return;
+    }
+  }
+
+  FinishUpdate();
+  UpdateBusy = false;
+  if (UpdateCompleteCallback != NULL) {
+    UpdateCompleteCallback();
   }
 
-  checksum = calculateLRC(prependData + middleData);
-  PrintString(prependData + middleData + checksum);
+  // Move on to the newest presented frame, if there is one
+  if (FramePending && !UpdateBusy) {
+    FramePending = false;
+    StartUpdate(FrontBuffer, PendingFullRefresh);
+    PendingFullRefresh = false;
+  }
 }
 
-void mcp::PrintRegister7()
+void mcp::WaitUntilIdle()
 {
-  // Loop thru correct number of bytes for this register
-  // Concat any before/after text
-  // Call calculate checksum
-  // Print final String
+  // Block until any asynchronous update has been sent
+  while (UpdateBusy) {
+    tick();
+    yield();
+  }
+}
 
-  int startingPoint = 80;
-  int numOfBytesToChewOff = 16;
-  String prependData = ""; // Per-register string to start with
-  String middleData = "";
-  String checksum = ""; // Per-register checksum to be calculated
+bool mcp::isBusy()
+{
+  return UpdateBusy;
+}
 
-  prependData = ":10007000";
+void mcp::setUpdateCompleteCallback(void (*callback)())
+{
+  // Called from tick() when an asynchronous update finishes. Pass NULL to remove.
+  UpdateCompleteCallback = callback;
+}
 
-  for (int i = startingPoint; i < startingPoint + numOfBytesToChewOff; i++) {
-    char sBuffer [4];
-    sprintf(sBuffer, "%0.2X", Bytestream[i]);
-    middleData.concat(sBuffer[0]);
-    middleData.concat(sBuffer[1]);
+uint16_t mcp::PrepareUpdate(const uint16_t *columns, bool forceFullRefresh)
+{
+  // Convert bitmap to correct stream of bytes
+  PROFILE_MARK(convertStart);
+  CopyColumnsToBytestream(columns);
+  PROFILE_SINCE(convertMicros, convertStart);
+
+  // Work out which registers differ from what the sign already has
+  UpdatePack = NULL;
+  bool fullRefresh = forceFullRefresh || !SentBytestreamValid;
+  UpdateRegisters = 0;
+  for (byte reg = 0; reg < Layout.numRegisters; reg++) {
+    if (fullRefresh || RegisterChanged(reg)) {
+      UpdateRegisters |= (uint16_t)1 << reg;
+    }
   }
-
-  checksum = calculateLRC(prependData + middleData);
-  PrintString(prependData + middleData + checksum);
+  return UpdateRegisters;
 }
 
-void mcp::PrintRegister8()
+uint16_t mcp::PrepareRegisters(uint16_t registers)
 {
-  // Loop thru correct number of bytes for this register
-  // Concat any before/after text
-  // Call calculate checksum
-  // Print final String
-
-  int startingPoint = 96;
-  int numOfBytesToChewOff = 16;
-  String prependData = ""; // Per-register string to start with
-  String middleData = "";
-  String checksum = ""; // Per-register checksum to be calculated
+  // Like PrepareUpdate(), with the registers picked by the caller instead of by comparing
+  UpdateRegisters = registers & (uint16_t)((1UL << Layout.numRegisters) - 1);
+  if (UpdateRegisters == 0) {
+    return 0;
+  }
+  PROFILE_MARK(convertStart);
+  CopyColumnsToBytestream(Framebuffer);
+  PROFILE_SINCE(convertMicros, convertStart);
 
-  prependData = ":10008000";
+  UpdatePack = NULL;
+  return UpdateRegisters;
+}
 
-  for (int i = startingPoint; i < startingPoint + numOfBytesToChewOff; i++) {
-    char sBuffer [4];
-    sprintf(sBuffer, "%0.2X", Bytestream[i]);
-    middleData.concat(sBuffer[0]);
-    middleData.concat(sBuffer[1]);
+const char *mcp::UpdateLine(byte step)
+{
+  // Returns the line to send for one step of an update,
+  // or NULL if this step is a register that does not need sending.
+  byte stepFirstCommit = stepFirstRegister + Layout.numRegisters;
+  if (step < stepFirstRegister) {
+    return Layout.selectLine; // Tell sign we are about to send a new image
+  }
+  if (step < stepFirstCommit) {
+    // Computed image registers, these contain the sign image data
+    byte reg = step - stepFirstRegister;
+    if (UpdateRegisters & ((uint16_t)1 << reg)) {
+      return (UpdatePack != NULL) ? PackLine(reg) : EncodeRegister(reg);
+    }
+    return NULL;
   }
+  if (step < stepFirstCommit + Layout.numCommitLines) {
+    return Layout.commitLines[step - stepFirstCommit]; // Tell the sign to display the image!
+  }
+  return NULL;
+}
 
-  checksum = calculateLRC(prependData + middleData);
-  PrintString(prependData + middleData + checksum);
+const char *mcp::NextLine()
+{
+  // The line for UpdateStep onward, skipping over registers that do not need sending.
+  // NULL once every line of the update has been handed out.
+  byte stepEndOfUpdate = StepEndOfUpdate();
+  const char *line = NULL;
+  while (UpdateStep < stepEndOfUpdate && line == NULL) {
+    line = UpdateLine(UpdateStep++);
+  }
+  return line;
 }
 
-void mcp::PrintRegister9()
+byte mcp::StepWire(byte step)
 {
-  // Loop thru correct number of bytes for this register
-  // Concat any before/after text
-  // Call calculate checksum
-  // Print final String
+  // What the line of an update step is, for its answer
+  if (step >= stepFirstRegister && step < stepFirstRegister + Layout.numRegisters) {
+    return step - stepFirstRegister;
+  }
+  return wireUpdateLine;
+}
 
-  int startingPoint = 112;
-  int numOfBytesToChewOff = 16;
-  String prependData = ""; // Per-register string to start with
-  String middleData = "";
-  String checksum = ""; // Per-register checksum to be calculated
+unsigned long mcp::estimateUpdateMicros(uint16_t registers)
+{
+  // Every image register line is the same length, see mcpPackLineLength
+  unsigned long lineDelay = LineDelay * 1000UL;
+  unsigned long total = Transport.wireMicros(strlen(Layout.selectLine) + 2) + lineDelay;
+  for (byte reg = 0; reg < Layout.numRegisters; reg++) {
+    if (registers & ((uint16_t)1 << reg)) {
+      total += Transport.wireMicros(lineBufferSize - 1 + 2) + lineDelay;
+    }
+  }
+  for (byte i = 0; i < Layout.numCommitLines; i++) {
+    total += Transport.wireMicros(strlen(Layout.commitLines[i]) + 2) + lineDelay;
+  }
+  return total + EndOfUpdateDelay * 1000UL;
+}
 
-  prependData = ":10009000";
+unsigned long mcp::nextFrameDeadline()
+{
+  return SettledAt;
+}
 
-  for (int i = startingPoint; i < startingPoint + numOfBytesToChewOff; i++) {
-    char sBuffer [4];
-    sprintf(sBuffer, "%0.2X", Bytestream[i]);
-    middleData.concat(sBuffer[0]);
-    middleData.concat(sBuffer[1]);
-  }
+void mcp::setSettleTime(unsigned int ms)
+{
+  SettleTime = ms;
+}
 
-  checksum = calculateLRC(prependData + middleData);
-  PrintString(prependData + middleData + checksum);
+unsigned int mcp::getSettleTime()
+{
+  return SettleTime;
 }
 
-void mcp::PrintRegisterA()
+unsigned long mcp::SendLine(const char *line, byte wire)
 {
-  // Loop thru correct number of bytes for this register
-  // Concat any before/after text
-  // Call calculate checksum
-  // Print final String
+  // Hand a line to the serial port without waiting for it to go out, see WriteLine().
+  // Returns how many ms it spends on the wire, rounded up.
+  WriteLine(line, wire);
+  int length = strlen(line) + 2; // CRLF
+  return (Transport.wireMicros(length) + 999) / 1000;
+}
 
-  int startingPoint = 128;
-  int numOfBytesToChewOff = 16;
-  String prependData = ""; // Per-register string to start with
-  String middleData = "";
-  String checksum = ""; // Per-register checksum to be calculated
+byte mcp::StepEndOfData()
+{
+  // The step after the first commit line, which ends the image load.
+  // From the select line up to here the sign takes every image register sent on the line.
+  return stepFirstRegister + Layout.numRegisters + 1;
+}
 
-  prependData = ":1000A000";
+byte mcp::StepEndOfUpdate()
+{
+  // The step after the last commit line
+  return stepFirstRegister + Layout.numRegisters + Layout.numCommitLines;
+}
 
-  for (int i = startingPoint; i < startingPoint + numOfBytesToChewOff; i++) {
-    char sBuffer [4];
-    sprintf(sBuffer, "%0.2X", Bytestream[i]);
-    middleData.concat(sBuffer[0]);
-    middleData.concat(sBuffer[1]);
+void mcp::FinishUpdate()
+{
+  // The update is over, end of update delay included. Now the sign settles.
+  SettledAt = millis() + SettleTime;
+  PROFILE_MAX(worstUpdateMicros, UpdateStartMicros);
+#if MCP_PROFILE
+  for (byte reg = 0; reg < Layout.numRegisters; reg++) {
+    if (UpdateRegisters & ((uint16_t)1 << reg)) {
+      Profile.registersSent++;
+    } else {
+      Profile.registersSkipped++;
+    }
   }
-
-  checksum = calculateLRC(prependData + middleData);
-  PrintString(prependData + middleData + checksum);
+#endif
+
+  // An answer to the last line may still be waiting
+  ReadReplies();
+  WireLine = wireOtherLine;
+
+  // Remember what the sign has now. A register the sign did not take keeps its old
+  // contents in SentBytestream, so the next update sends it again.
+  uint16_t taken = UpdateRegisters & ~FailedRegisters;
+  if (UpdatePack != NULL) {
+    // Bytestream does not have the pack's frame in it, the next image goes in full
+    SentBytestreamValid = false;
+    PackShown = (taken == UpdateRegisters) ? UpdatePack : NULL;
+    PackFrameShown = UpdatePackIndex;
+    UpdatePack = NULL;
+  } else {
+    // Only the registers that were sent, a region update leaves the others as they were
+    for (byte reg = 0; reg < Layout.numRegisters; reg++) {
+      if (taken & ((uint16_t)1 << reg)) {
+        const mcpRegister &r = Layout.registers[reg];
+        memcpy(&SentBytestream[r.start], &Bytestream[r.start], r.count);
+      }
+    }
+    if (taken == (uint16_t)((1UL << Layout.numRegisters) - 1)) {
+      SentBytestreamValid = true;
+    }
+    PackShown = NULL;
+  }
+  FailedRegisters = 0;
+  FramesSent++;
+  PROFILE_COUNT(updates, 1);
 }
 
-void mcp::PrintRegisterB()
+void mcp::ConvertBitmapToBytestream()
 {
-  // Loop thru correct number of bytes for this register
-  // Concat any before/after text
-  // Call calculate checksum
-  // Print final String
+  // Convert what has been drawn so far (the back buffer)
+  CopyColumnsToBytestream(Framebuffer);
+}
 
-  int startingPoint = 144;
-  int numOfBytesToChewOff = 16;
-  String prependData = ""; // Per-register string to start with
-  String middleData = "";
-  String checksum = ""; // Per-register checksum to be calculated
+void mcp::CopyColumnsToBytestream(const uint16_t *columns)
+{
+  // The framebuffer already keeps each column in the sign's bit order:
+  // the low byte holds dots 0-7 and the high byte dots 8-15, with the
+  // top dot of each half in the least significant bit.
+  // So each column is just split into its two bytes.
+  int byteStreamCounter = 0;
+  for (int x = 0; x < Layout.columns; x++) { // Loop thru each column
+    Bytestream[byteStreamCounter++] = lowByte(columns[x]);
+    Bytestream[byteStreamCounter++] = highByte(columns[x]);
+  }
+}
 
-  prependData = ":1000B000";
+void mcp::InitSign()
+{
+  // This must be run once after the sign is physically powered on.
+  // This command puts the sign into "ready" mode, where it waits for new data.
+  // The lines are built for this sign's ID at compile time, see mcpSignLayout.
+  WaitUntilIdle(); // Let an asynchronous update finish first
+  SentBytestreamValid = false; // The next UpdateSign() must send every register
+  PackShown = NULL;
+  for (byte i = 0; i < Layout.numInitLines; i++) {
+    PrintLine(Layout.initLines[i]);
+  }
+}
 
-  for (int i = startingPoint; i < startingPoint + numOfBytesToChewOff; i++) {
-    char sBuffer [4];
-    sprintf(sBuffer, "%0.2X", Bytestream[i]);
-    middleData.concat(sBuffer[0]);
-    middleData.concat(sBuffer[1]);
+void mcp::CloseSign()
+{
+  // This can be run before 24v power is shutdown to the sign.
+  // This command will fully clear the sign, writing a hard flip off to each dot.
+  // The lines are built for this sign's ID at compile time, see mcpSignLayout.
+  // The sign generally needs to be power cycled after you shut it down with this command.
+  // Also note, if the 12v power alone is removed from the sign, the sign will initiate
+  // this same shutdown code on its own.
+  WaitUntilIdle(); // Let an asynchronous update finish first
+  SentBytestreamValid = false; // The next UpdateSign() must send every register
+  PackShown = NULL;
+  for (byte i = 0; i < Layout.numCloseLines; i++) {
+    PrintLine(Layout.closeLines[i]);
   }
+}
 
-  checksum = calculateLRC(prependData + middleData);
-  PrintString(prependData + middleData + checksum);
+void mcp::PrintString(String in)
+{
+  // Kept for sending arbitrary lines, see PrintLine()
+  PrintLine(in.c_str());
 }
 
-void mcp::PrintRegisterC()
+void mcp::PrintLine(const char *line)
 {
-  // Loop thru correct number of bytes for this register
-  // Concat any before/after text
-  // Call calculate checksum
-  // Print final String
+  // This will write data to the serial device that is hooked to RS485,
+  // and wait for it to go out, plus the line delay
+  WriteLine(line, wireOtherLine);
+  WaitLineGap();
+}
 
-  int startingPoint = 160;
-  int numOfBytesToChewOff = 16;
-  String prependData = ""; // Per-register string to start with
-  String middleData = "";
-  String checksum = ""; // Per-register checksum to be calculated
+void mcp::WriteLine(const char *line, byte wire)
+{
+  // Hand a line to the transport, which sends it in the background (a serial port's
+  // transmit interrupt sends it from its buffer; with a buffer smaller than a line, the
+  // write blocks until the rest fits, see mcpSerialTransport). The line before has
+  // gone, WaitLineGap() saw to that, so this one is on the wire until LineOnWireUntil.
+  // In case the sign is talking to us, count what it said and move on
+  ReadReplies();
+  WireLine = wire;
+
+  size_t length = strlen(line);
+  LineOnWireUntil = micros() + Transport.wireMicros(length + 2); // CRLF
+  PROFILE_MARK(writeStart);
+  Transport.writeLine(line, length);
+  PROFILE_SINCE(writeMicros, writeStart);
+  PROFILE_COUNT(lines, 1);
+  PROFILE_COUNT(bytes, length + 2);
+}
 
-  prependData = ":1000C000";
+void mcp::WaitLineGap()
+{
+  // Wait for the line WriteLine() sent to leave the port, then for the line delay
+  // (or the sign's answer). Both are timed, nothing polls the port byte by byte.
+  PROFILE_MARK(flushStart);
+  while ((long)(LineOnWireUntil - micros()) > 0) {
+    yield();
+  }
+  Transport.flush(); // The last bits are out by now, this returns straight away
+  PROFILE_SINCE(flushMicros, flushStart);
 
-  for (int i = startingPoint; i < startingPoint + numOfBytesToChewOff; i++) {
-    char sBuffer [4];
-    sprintf(sBuffer, "%0.2X", Bytestream[i]);
-    middleData.concat(sBuffer[0]);
-    middleData.concat(sBuffer[1]);
+  PROFILE_MARK(eolStart);
+  if (ResponsePacing) {
+    WaitForReply(); // Go on as soon as the sign has answered
+  } else {
+    unsigned long gapStart = micros();
+    while (micros() - gapStart < LineDelay * 1000UL) { // Delay in ms after each line is sent
+      yield();
+    }
   }
+  PROFILE_SINCE(eolMicros, eolStart);
 
-  checksum = calculateLRC(prependData + middleData);
-  PrintString(prependData + middleData + checksum);
+  // In case the sign is responding, count what it said
+  ReadReplies();
 }
 
-void mcp::PrintRegisterD()
+void mcp::WaitForReply()
 {
-  // Loop thru correct number of bytes for this register
-  // Concat any before/after text
-  // Call calculate checksum
-  // Print final String
-
-  int startingPoint = 176;
-  int numOfBytesToChewOff = 16;
-  String prependData = ""; // Per-register string to start with
-  String middleData = "";
-  String checksum = ""; // Per-register checksum to be calculated
+  // Wait for the sign to answer the line just sent.
+  // With no answer in ResponseTimeout ms this is the same as delay(LineDelay), or longer.
+  unsigned long start = millis();
+  unsigned int timeout = (ResponseTimeout < LineDelay) ? LineDelay : ResponseTimeout;
+  ReplyDigits = -1;
+  while (!ReadReply()) {
+    if (millis() - start >= timeout) {
+      LinkStats.timeouts++;
+      LineFailed();
+      return;
+    }
+    yield();
+  }
+}
 
-  prependData = ":1000D000";
+void mcp::ReadReplies()
+{
+  // Read and count everything the sign has sent so far
+  while (ReadReply()) {
+  }
+}
 
-  for (int i = startingPoint; i < startingPoint + numOfBytesToChewOff; i++) {
-    char sBuffer [4];
-    sprintf(sBuffer, "%0.2X", Bytestream[i]);
-    middleData.concat(sBuffer[0]);
-    middleData.concat(sBuffer[1]);
+void mcp::LineFailed()
+{
+  // The sign NAKed the line last sent, the answer was garbled, or none came.
+  // Answers are taken to be for the line before them, which holds as long as the
+  // sign answers within the line delay.
+  if (WireLine < Layout.numRegisters) {
+    FailedRegisters |= (uint16_t)1 << WireLine;
+  } else if (WireLine == wireUpdateLine) {
+    FailedRegisters = UpdateRegisters; // The image may not have been loaded or shown at all
   }
+}
 
-  checksum = calculateLRC(prependData + middleData);
-  PrintString(prependData + middleData + checksum);
+bool mcp::ReadReply()
+{
+  // Read whatever the sign has sent so far, without waiting.
+  // Answers look like our lines, ":" + hex bytes + LRC + CRLF, and are checked
+  // a character at a time so nothing is buffered. Returns true once a whole
+  // answer has been read and counted in LinkStats.
+  while (Transport.available() > 0) {
+    char c = Transport.read();
+    PROFILE_COUNT(replyBytes, 1);
+    if (c == ':') {
+      // Start of an answer, anything before it is ignored
+      ReplyDigits = 0;
+      ReplySum = 0;
+      ReplyType = 0;
+      ReplyBad = false;
+    } else if (ReplyDigits < 0) {
+      PROFILE_COUNT(discardedBytes, 1);
+    } else if (c == '\r') {
+      continue;
+    } else if (c == '\n') {
+      // End of the answer. It needs at least length, address, type and LRC.
+      bool complete = !ReplyBad && (ReplyDigits % 2) == 0 && ReplyDigits >= 10;
+      if (!complete || ReplySum != 0) {
+        LinkStats.badLrc++;
+        LineFailed();
+      } else if (ReplyType & 0x80) {
+        LinkStats.naks++;
+        LineFailed();
+      } else {
+        LinkStats.acks++;
+      }
+      ReplyDigits = -1;
+      return true;
+    } else {
+      int value = toDec(c);
+      if (c < '0' || c > 'F' || (c > '9' && c < 'A')) {
+        ReplyBad = true;
+        value = 0;
+      }
+      ReplyByte = (ReplyByte << 4) | value;
+      if (ReplyDigits++ & 1) {
+        ReplySum += ReplyByte;
+        if (ReplyDigits == 8) {
+          ReplyType = ReplyByte; // Fourth byte
+        }
+      }
+    }
+  }
+  return false;
 }
 
-void mcp::PrintRegisterE()
+const char *mcp::EncodeRegister(byte reg)
 {
-  // Loop thru correct number of bytes for this register
-  // Concat any before/after text
-  // Call calculate checksum
-  // Print final String
+  // Build the line for one image register in LineBuffer, using the register map
+  // to know which bytes of Bytestream go where.
+  // The LRC is summed as each byte is written, so the line never has to be parsed again.
+  // Clocks, countdowns and alternating messages send the same few register contents
+  // over and over, so the last MCP_LINE_CACHE lines of each register are kept, keyed by
+  // the register's bytes, and a repeat is sent without encoding anything.
+  PROFILE_MARK(encodeStart);
+  const mcpRegister &r = Layout.registers[reg];
+#if MCP_LINE_CACHE
+  mcpLineCacheSet &set = LineCache[reg];
+  for (byte way = 0; way < MCP_LINE_CACHE; way++) {
+    mcpCachedLine &cached = set.ways[way];
+    if (cached.valid && memcmp(cached.data, &Bytestream[r.start], r.count) == 0) {
+      LineCacheStats.hits++;
+      PROFILE_SINCE(encodeMicros, encodeStart);
+      return cached.line;
+    }
+  }
+#endif
+  LineCacheStats.misses++;
 
-  int startingPoint = 192;
-  int numOfBytesToChewOff = 4;
-  String prependData = ""; // Per-register string to start with
-  String middleData = "";
-  String checksum = ""; // Per-register checksum to be calculated
+  byte lrc = 0;
+  char *out = LineBuffer;
 
-  prependData = ":1000E000";
+  *out++ = ':';
+  out = appendHexByte(out, 0x10, lrc); // 16 bytes of data
+  out = appendHexByte(out, 0x00, lrc);
+  out = appendHexByte(out, r.address, lrc);
+  out = appendHexByte(out, 0x00, lrc);
 
-  for (int i = startingPoint; i < startingPoint + numOfBytesToChewOff; i++) {
-    char sBuffer [4];
-    sprintf(sBuffer, "%0.2X", Bytestream[i]);
-    middleData.concat(sBuffer[0]);
-    middleData.concat(sBuffer[1]);
+  for (byte i = 0; i < r.headerBytes; i++) {
+    out = appendHexByte(out, imageHeader[i], lrc);
   }
+  out = appendZeros(out, r.leadZeros);
+  for (byte i = 0; i < r.count; i++) {
+    out = appendHexByte(out, Bytestream[r.start + i], lrc);
+  }
+  out = appendZeros(out, r.tailZeros);
+
+  byte unused = 0;
+  out = appendHexByte(out, (byte)(-lrc), unused); // LRC is the two's complement of the sum
+  *out = '\0';
+
+#if MCP_LINE_CACHE
+  // Keep it in place of the oldest line
+  mcpCachedLine &replaced = set.ways[set.next];
+  set.next = (set.next + 1) % MCP_LINE_CACHE;
+  replaced.valid = true;
+  memcpy(replaced.data, &Bytestream[r.start], r.count);
+  memcpy(replaced.line, LineBuffer, out - LineBuffer + 1);
+#endif
+
+  PROFILE_SINCE(encodeMicros, encodeStart);
+  return LineBuffer;
+}
 
-  middleData.concat("000000000000000000000000"); // Special for end register, E
+bool mcp::RegisterChanged(byte reg)
+{
+  // Compare this register's slice of Bytestream with what was last sent.
+  // Registers that carry no image data (R2) never change.
+  const mcpRegister &r = Layout.registers[reg];
+  return memcmp(&Bytestream[r.start], &SentBytestream[r.start], r.count) != 0;
+}
 
-  checksum = calculateLRC(prependData + middleData);
-  PrintString(prependData + middleData + checksum);
+void mcp::PrintRegister(byte reg)
+{
+  // Encode and send a single image register (0 thru E on the front sign)
+  PrintLine(EncodeRegister(reg));
 }
 
 
 // LRC calculation code, credit to author Kunchala Anil
+// No longer used for the image registers (see EncodeRegister()), but kept for checking
+// hand written lines. Sums the hex pairs after the ':' and returns the LRC as hex.
 String mcp::calculateLRC(String input)
 {
-  char * a = (char *)input.c_str();
+  const char * a = input.c_str();
   int myLength = strlen(a);
-  int val[myLength / 2];
-  for (int i = 1, j = 0 ; i < strlen(a); i = i + 2, j++ )
+  byte sum = 0;
+  for (int i = 1; i + 1 < myLength; i = i + 2)
   {
-    val[j] = conv(a[i], a[i + 1]);
-  }
-  int sum = find_sum(val, myLength);
-  char hex[5];
-  utoa((unsigned)sum, hex, 16);
-  int hex_val = (int)strtol(hex, NULL, 16);
-  hex_val = ((~hex_val) + B01) & 0xff;
-  char hex_val_str[4];
-  sprintf(hex_val_str, "%0.2X", hex_val);
+    sum += conv(a[i], a[i + 1]);
+  }
+  byte lrc = -sum;
+  char hex_val_str[3] = {hexDigits[lrc >> 4], hexDigits[lrc & 0x0F], '\0'};
   String finally = hex_val_str;
   return finally;
 }
@@ -640,16 +1200,4 @@ int mcp::conv(char val1, char val2)
   return (val_a * 16) + val_b;
 }
 
-int mcp::find_sum(const int * val, int myLength)
-{
-  {
-    int sum = 0;
-    for (int i = 0; i <= (myLength / 2) - 1; i++)
-    {
-      sum = sum + val[i];
-    }
-    return sum;
-  }
-}
-
 
@@ -21,55 +21,362 @@
 
 #include "Arduino.h"
 #include <Adafruit_GFX.h>
+#include "Modbus_SignLayout.h"
+#include "Modbus_Pack.h"
+#include "Modbus_Bitmap.h"
+#include "Modbus_Transport.h"
 
-#define SERIALDEVICE Serial3 // This serial port should be connected to an RS485 converter
-
-// Note that this library is tailored to 98x16. It would require work to adapt to other sizes.
-const int xSize = 98; // Enter the real number of x dots (1 indexed)
-const int ySize = 16; // Enter the real number of y dots (1 indexed)
-const int byteStreamSize = ((xSize*ySize) / 8); // Number of bytes of sign data
-const int eolDelay = 10; // Number of milliseconds to delay after each EOL (10 is good, 9 minimum)
+// The width, sign ID and register map come from the mcpSign template, see the bottom of this file.
+const int ySize = 16; // Every sign is 16 dots tall
+static_assert(ySize == 16, "The framebuffer packs one column of dots into a 16-bit word");
+const int lineBufferSize = 44; // ':' + 20 bytes as hex + 2 LRC chars + NUL, longest line we send
+const int eolDelay = 10; // Number of milliseconds to delay after each EOL (10 is good, 9 minimum), see setLineDelay()
 const int endOfUpdateDelay = 0; // Number of milliseconds to delay after each sign update. (0 is default)
+const int settleTime = 0; // Milliseconds the sign needs to finish flipping after an update, see setSettleTime()
+const int calibrationMargin = 1; // Milliseconds added to the shortest line delay that calibrateLineDelay() saw work
+const int calibrationEepromAddress = 0; // Where saveCalibration() keeps its records
+const byte calibrationSlots = 4; // Calibrations kept in EEPROM, one per baud rate
+// What the line on the wire is, so a NAK or a missing answer can be put down to it:
+// an image register number, or one of these
+const byte wireUpdateLine = 0xFE; // The select line or a commit line of an update
+const byte wireOtherLine = 0xFF; // Anything else, or a line on a shared bus
+
+#ifndef MCP_EEPROM
+#define MCP_EEPROM 1 // Set to 0 on boards without EEPROM.h, saveCalibration()/loadCalibration() then do nothing
+#endif
+
+#ifndef MCP_NATIVE_TEXT
+#define MCP_NATIVE_TEXT 1 // Set to 0 to draw text through Adafruit_GFX, saves a copy of its 1280 byte font
+#endif
+
+// Encoded lines kept per register, see EncodeRegister(). Each is ~61 bytes of RAM for every
+// register, so 2 costs ~1.8 KB for the 15 register front sign: more than an AVR has to spare.
+#ifndef MCP_LINE_CACHE
+#if defined(__AVR__)
+#define MCP_LINE_CACHE 0
+#else
+#define MCP_LINE_CACHE 2
+#endif
+#endif
+
+#ifndef MCP_PROFILE
+#define MCP_PROFILE 1 // Set to 0 to compile out the update phase timing and counters (see getProfile())
+#endif
+
+// Clock used to time update phases. A board or the host build can supply a finer one.
+#ifndef MCP_PROFILE_MICROS
+#define MCP_PROFILE_MICROS() micros()
+#endif
+
+// Time spent in each phase of sending updates, summed since the last resetProfile()
+struct mcpProfile
+{
+  unsigned long updates;       // Updates sent, blocking or asynchronous
+  unsigned long lines;         // Lines written to the serial port
+  unsigned long bytes;         // Bytes written to the serial port, CRLF included
+  unsigned long convertMicros; // Framebuffer to Bytestream
+  unsigned long encodeMicros;  // Register lines to hex, the LRC is summed in the same pass
+  unsigned long writeMicros;   // Handing lines to the serial port
+  unsigned long flushMicros;   // Waiting for the serial port to finish sending
+  unsigned long eolMicros;     // Line delay and end of update delay waits, or waiting for replies
+  unsigned long updateMicros;  // Whole UpdateSign() calls, start to return
+  unsigned long worstUpdateMicros; // Longest update from its first line to finished, any kind
+  unsigned long registersSent;     // Image registers sent
+  unsigned long registersSkipped;  // Image registers left out, the sign already had them
+  unsigned long replyBytes;        // Bytes the sign sent back
+  unsigned long discardedBytes;    // Of those, bytes outside any answer, thrown away
+};
+
+// What the sign said back. Answers are counted with or without response pacing, as each
+// line is sent; only timeouts need pacing on. An image register that was NAKed, answered
+// with a bad LRC or timed out is sent again by the next update.
+struct mcpLinkStats
+{
+  unsigned long acks;     // Lines the sign answered normally
+  unsigned long naks;     // Answers with the exception bit (0x80) set in the record type
+  unsigned long badLrc;   // Answers with a wrong LRC, or that were not valid hex
+  unsigned long timeouts; // Paced lines with no answer in time, the fixed delay was used instead
+};
+
+// Hits and misses of the encoded line cache, see EncodeRegister()
+struct mcpLineCacheStats
+{
+  unsigned long hits;   // Registers sent with a line from the cache
+  unsigned long misses; // Registers that had to be encoded
+};
+
+// One encoded register line, and the register's bytes it was encoded from
+struct mcpCachedLine
+{
+  bool valid;
+  byte data[mcpRegisterSize];
+  char line[lineBufferSize];
+};
+
+// How drawColumns() combines columns with what is already drawn
+enum mcpBlitMode
+{
+  mcpBlitCopy, // Replace
+  mcpBlitOr,   // Turn on the dots that are on in the columns
+  mcpBlitAnd,  // Keep only the dots that are on in both
+  mcpBlitXor   // Flip the dots that are on in the columns
+};
+
+#if MCP_LINE_CACHE
+// The lines kept for one register. The oldest is replaced first.
+struct mcpLineCacheSet
+{
+  byte next; // The way to replace next
+  mcpCachedLine ways[MCP_LINE_CACHE];
+};
+#else
+struct mcpLineCacheSet;
+#endif
 
 class mcp : public Adafruit_GFX
 {
   public:
-    mcp(int baudRate);
     void drawPixel(int16_t x, int16_t y, uint16_t color);
+    bool getPixel(int16_t x, int16_t y);
     void dotOn(byte x, byte y);
     void dotOff(byte x, byte y);
     void dotAllOn();
     void dotAllOff();
     void invertAll();
-    void UpdateSign();
+    // Copy whole columns (same packing as the framebuffer) to columns x onward, clipped to the sign
+    void drawColumns(int16_t x, const uint16_t *columns, int16_t count, mcpBlitMode mode = mcpBlitCopy);
+    const uint16_t *getColumns(); // The back buffer, packed as drawColumns() takes it
+    // Decode a column bitmap from flash (see Modbus_Bitmap.h) into the framebuffer, its top
+    // left dot at x, y. Only the dots the bitmap covers are changed, whatever the mode.
+    void drawColumnBitmap(int16_t x, int16_t y, const mcpBitmap &bitmap, mcpBlitMode mode = mcpBlitCopy);
+    // Adafruit_GFX's row bitmaps, turned into columns 8x8 dots at a time (see Modbus_Bitmap.cpp).
+    // They are not virtual in Adafruit_GFX, so these are only used when drawing through an mcp.
+    using Adafruit_GFX::drawBitmap;
+    using Adafruit_GFX::drawGrayscaleBitmap;
+    void drawBitmap(int16_t x, int16_t y, const uint8_t bitmap[], int16_t w, int16_t h, uint16_t color);
+    void drawBitmap(int16_t x, int16_t y, const uint8_t bitmap[], int16_t w, int16_t h, uint16_t color, uint16_t bg);
+    void drawBitmap(int16_t x, int16_t y, uint8_t *bitmap, int16_t w, int16_t h, uint16_t color);
+    void drawBitmap(int16_t x, int16_t y, uint8_t *bitmap, int16_t w, int16_t h, uint16_t color, uint16_t bg);
+    void drawXBitmap(int16_t x, int16_t y, const uint8_t bitmap[], int16_t w, int16_t h, uint16_t color);
+    void drawGrayscaleBitmap(int16_t x, int16_t y, const uint8_t bitmap[], int16_t w, int16_t h);
+    void drawGrayscaleBitmap(int16_t x, int16_t y, uint8_t *bitmap, int16_t w, int16_t h);
+    // Dots whose gray level is threshold or more are on, the rest off
+    void drawGrayscaleBitmap(int16_t x, int16_t y, const uint8_t bitmap[], int16_t w, int16_t h, uint8_t threshold);
+    void drawGrayscaleBitmap(int16_t x, int16_t y, uint8_t *bitmap, int16_t w, int16_t h, uint8_t threshold);
+    // Adafruit_GFX draws these a dot at a time, here they are masks ORed into or cleared from
+    // whole columns. Lines, rectangles, circles and rounded rectangles are all drawn with them.
+    void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color);
+    void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color);
+    void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+    void fillScreen(uint16_t color);
+#if MCP_NATIVE_TEXT
+    // print() draws each glyph a column at a time straight into the framebuffer, see Modbus_Text.cpp
+    size_t write(uint8_t c);
+    using Adafruit_GFX::write;
+#endif
+    void UpdateSign(bool forceFullRefresh = false);
+    // Send only the registers holding columns x0 thru x1, changed or not, without comparing
+    // anything. Each register holds whole columns, so y0 and y1 make no difference.
+    void updateRegion(int16_t x0, int16_t y0, int16_t x1, int16_t y1);
+    bool beginUpdateRegion(int16_t x0, int16_t y0, int16_t x1, int16_t y1); // Asynchronous, see beginUpdate()
+    uint16_t getRegionRegisters(int16_t x0, int16_t x1); // Registers holding columns x0 thru x1, one bit each
+    // Send just these registers (bits as from getRegionRegisters()), e.g. of several regions at once
+    void updateRegisters(uint16_t registers);
+    bool beginUpdateRegisters(uint16_t registers); // Asynchronous, see beginUpdate()
+    // Asynchronous update: beginUpdate() snapshots the framebuffer, then call tick() from loop()
+    // until isBusy() is false. tick() never delays, it sends the next line once its time has come.
+    bool beginUpdate(bool forceFullRefresh = false);
+    void tick();
+    bool isBusy();
+    void setUpdateCompleteCallback(void (*callback)());
+    // Double buffering: drawing always goes to the back buffer, present() hands it to the
+    // transmitter. Frames presented while an update is running wait, and only the newest is sent.
+    void present(bool forceFullRefresh = false);
+    unsigned long getFramesPresented();
+    unsigned long getFramesSent();
+    unsigned long getFramesCoalesced();
+    mcpProfile getProfile(); // A copy, cheap enough to take every frame
+    void resetProfile();
+    // Frame, link, line cache and profile counters as "name value" lines, e.g. on a debug port
+    void printStats(Print &out);
+    // Response pacing: send the next line as soon as the sign answers the last one,
+    // instead of always waiting eolDelay. A line with no answer within timeoutMs
+    // falls back to the fixed delay (the timeout is never shorter than the line delay).
+    void setResponsePacing(bool enabled, unsigned int timeoutMs = eolDelay);
+    mcpLinkStats getLinkStats();
+    void resetLinkStats();
+    // Registers whose bytes match a line encoded recently reuse it, see EncodeRegister()
+    mcpLineCacheStats getLineCacheStats();
+    void resetLineCacheStats();
+    // Timing model, see Modbus_Pacer.h. The estimate is the wire time of the lines for these
+    // registers (one bit each) plus the select and commit lines, the line delays and the end of
+    // update delay. The settle time is how long the sign needs after that (to flip its dots)
+    // before the next frame. nextFrameDeadline() is the millis() at which the update running,
+    // or the last one sent, has settled. It is an estimate while an update is running.
+    unsigned long estimateUpdateMicros(uint16_t registers);
+    unsigned long nextFrameDeadline();
+    void setSettleTime(unsigned int ms);
+    unsigned int getSettleTime();
+    // Delays start out as eolDelay and endOfUpdateDelay, and can be changed at any time
+    void setLineDelay(unsigned int ms);
+    unsigned int getLineDelay();
+    void setEndOfUpdateDelay(unsigned int ms);
+    unsigned int getEndOfUpdateDelay();
+    // Find the shortest line delay the sign keeps up with by sending test frames, see Modbus_Calibrate.cpp.
+    // Needs a sign (or simulator) that answers each line. Draws over the framebuffer.
+    int calibrateLineDelay(unsigned int startMs = eolDelay, unsigned int minMs = 1, byte framesPerStep = 3);
+    bool saveCalibration(); // Keep the delays in EEPROM for this baud rate
+    bool loadCalibration(); // Use the delays saved for this baud rate, false if there are none
+    // Play a frame of an animation pack encoded ahead of time, see Modbus_Pack.h.
+    // False if the pack is for another sign size, or frame does not follow the one shown.
+    bool playFrame(const mcpPack &pack, uint16_t frame);
+    bool beginFrame(const mcpPack &pack, uint16_t frame); // Asynchronous version, see beginUpdate()
+    const mcpLayout &getLayout();
     void ConvertBitmapToBytestream();
     void InitSign();
     void CloseSign();
     void PrintString(String in);
-    void PrintRegister0();
-    void PrintRegister1();
-    void PrintRegister2();
-    void PrintRegister3();
-    void PrintRegister4();
-    void PrintRegister5();
-    void PrintRegister6();
-    void PrintRegister7();
-    void PrintRegister8();
-    void PrintRegister9();
-    void PrintRegisterA();
-    void PrintRegisterB();
-    void PrintRegisterC();
-    void PrintRegisterD();
-    void PrintRegisterE();
+    void PrintLine(const char *line);
+    const char *EncodeRegister(byte reg);
+    const char *PackLine(byte reg);
+    void PrintRegister(byte reg);
+    bool RegisterChanged(byte reg);
+    uint16_t PrepareUpdate(const uint16_t *columns, bool forceFullRefresh);
+    uint16_t PrepareRegisters(uint16_t registers);
+    bool PreparePackFrame(const mcpPack &pack, uint16_t frame);
+    bool StartUpdate(const uint16_t *columns, bool forceFullRefresh);
+    void StartSending();
+    void SendPrepared();
+    void CopyColumnsToBytestream(const uint16_t *columns);
+    const char *UpdateLine(byte step);
+    const char *NextLine();
+    byte StepWire(byte step);
+    unsigned long SendLine(const char *line, byte wire);
+    byte StepEndOfData();
+    byte StepEndOfUpdate();
+    void FinishUpdate();
+    void WaitUntilIdle();
+    void WriteLine(const char *line, byte wire);
+    void WaitLineGap();
+    void WaitForReply();
+    void MarkUpdateStart();
+    void FillColumns(int16_t x, int16_t w, uint16_t mask, uint16_t color);
+    void BlitColumns(int16_t x, int16_t w, uint16_t bits, uint16_t mask, mcpBlitMode mode);
+    void DrawRowBitmap(int16_t x, int16_t y, const uint8_t *bitmap, bool progmem, bool lsbFirst,
+                       int16_t w, int16_t h, uint16_t color, uint16_t bg, bool opaque);
+    void DrawGrayscale(int16_t x, int16_t y, const uint8_t *bitmap, bool progmem,
+                       int16_t w, int16_t h, uint8_t low, uint8_t high);
+    bool ReadReply();
+    void ReadReplies();
+    void LineFailed();
+    bool CalibrationFrameAccepted(bool invert);
+#if MCP_NATIVE_TEXT
+    bool DrawClassicChar(int16_t x, int16_t y, unsigned char c);
+    bool DrawFontChar(int16_t x, int16_t y, unsigned char c);
+    void DrawGlyphColumn(int16_t x, int16_t y, uint32_t dots, uint32_t cell);
+#endif
     // Credit to author Kunchala Anil for C++ Arduino modbus LRC calculation code below:
     String calculateLRC(String input);
     int toDec(char val);
     int conv(char val1,char val2);
-    int find_sum(const int * val, int myLength);
-    
+
+  protected:
+    // Use mcpSign, which supplies the layout and the buffers for its size
+    mcp(int baudRate, mcpTransport &transport, const mcpLayout &layout, uint16_t *backBuffer,
+        uint16_t *frontBuffer, byte *bytestream, byte *sentBytestream, mcpLineCacheSet *lineCache);
+
   private:
-    bool BitmapMatrix[xSize][ySize]; // Create a 2D array to hold the "human" readable bitmap sign image.
-    byte Bytestream[byteStreamSize]; // Create a stream of bytes that will be sent to the sign via modbus
+    friend class mcpBus; // Runs updates of several signs on one line, see Modbus_Bus.h
+    const mcpLayout &Layout; // Size, register map and command lines of this sign
+    mcpTransport &Transport; // Where the lines go, see Modbus_Transport.h
+    unsigned long BaudRate; // Calibrations are saved per baud rate
+    // Framebuffers hold one 16-bit word per column, bit N is dot N from the top (same order as Bytestream)
+    uint16_t *Framebuffer; // Back buffer, everything draws into this one
+    uint16_t *FrontBuffer; // Last presented frame, read by the transmitter
+    bool FramePending; // FrontBuffer holds a frame that has not been sent yet
+    bool PendingFullRefresh; // The pending frame asked for a full refresh
+    unsigned long FramesPresented;
+    unsigned long FramesSent;
+    unsigned long FramesCoalesced; // Presented frames replaced by a newer one before they were sent
+    byte *Bytestream; // Create a stream of bytes that will be sent to the sign via modbus
+    byte *SentBytestream; // Copy of the last Bytestream the sign received, used to skip unchanged registers
+    bool SentBytestreamValid; // False until every register has been sent, or after InitSign()/CloseSign()
+    char LineBuffer[lineBufferSize]; // Encoded register line, reused for every register so nothing touches the heap
+    mcpLineCacheSet *LineCache; // One set per register, NULL when MCP_LINE_CACHE is 0
+    mcpLineCacheStats LineCacheStats;
+    uint16_t UpdateRegisters; // Registers being sent by the current update, one bit per register
+    const mcpPack *UpdatePack; // Pack the current update's lines come from, NULL when they are encoded
+    mcpPackFrame UpdatePackFrame; // Its frame record, copied out of flash
+    uint16_t UpdatePackIndex;
+    const mcpPack *PackShown; // Pack the sign is showing a frame of, NULL for none
+    uint16_t PackFrameShown;
+    byte UpdateStep; // Next step of the update, see UpdateLine()
+    const char *AheadLine; // Line tick() encoded while the one before was on the wire, NULL for none
+    byte AheadWire; // What AheadLine is, see wireUpdateLine
+    byte WireLine; // What the line last sent is, see wireUpdateLine
+    uint16_t FailedRegisters; // Registers of this update the sign NAKed, garbled the answer to or did not answer
+    unsigned long LineOnWireUntil; // micros() at which the line WriteLine() sent has left the port
+    bool UpdateBusy; // True while an asynchronous update is in progress
+    unsigned long UpdateDeadline; // millis() at which tick() may send the next line
+    void (*UpdateCompleteCallback)(); // Called by tick() when an asynchronous update has finished
+#if MCP_PROFILE
+    mcpProfile Profile; // Phase timing and counters
+    unsigned long UpdateStartMicros; // When the update running sent its first line
+#endif
+    unsigned int LineDelay; // Milliseconds to wait after each line, eolDelay unless changed
+    unsigned int EndOfUpdateDelay; // Milliseconds to wait after each update, endOfUpdateDelay unless changed
+    unsigned int SettleTime; // Milliseconds the sign needs after an update before the next, settleTime unless changed
+    unsigned long SettledAt; // millis() at which the update running or last sent has settled, see nextFrameDeadline()
+    bool ResponsePacing; // Wait for the sign's answer to each line instead of LineDelay
+    unsigned int ResponseTimeout; // Milliseconds to wait for an answer once a line has been sent, at least LineDelay
+    bool AwaitingReply; // tick() is waiting for the answer to the line it sent last
+    int ReplyDigits; // Hex digits of the answer read so far, -1 until its ':' arrives
+    byte ReplyByte; // Byte being assembled from the answer's hex digits
+    byte ReplyType; // Record type of the answer
+    byte ReplySum; // Sum of the answer's bytes, zero when the LRC is good
+    bool ReplyBad; // The answer had something other than hex digits in it
+    mcpLinkStats LinkStats;
+};
+
+// Buffers for a sign Columns dots across.
+// mcpSign inherits these privately, ahead of mcp: base classes are constructed in the
+// order they are listed, so the arrays exist before mcp's constructor is handed pointers
+// into them, and a sign's whole size is fixed at compile time with nothing on the heap.
+// mcpStripStorage, mcpIngestStorage and mcpZoneStorage do the same for their classes.
+template <int Columns, int Registers>
+struct mcpSignStorage
+{
+  uint16_t frameBuffers[2][Columns];
+  byte bytestream[2 * Columns];
+  byte sentBytestream[2 * Columns];
+#if MCP_LINE_CACHE
+  mcpLineCacheSet lineCache[Registers];
+  mcpLineCacheSet *lineCacheSets() { return lineCache; }
+#else
+  mcpLineCacheSet *lineCacheSets() { return NULL; }
+#endif
 };
 
+// A sign Columns dots across, answering to SignId, see mcpSignLayout for GapStart and GapColumns.
+// The register map and command lines are built by the compiler, e.g. for our signs:
+//   mcpSign<98, 6, 14, 14> front(19200);
+//   mcpSign<112, SIDE_ID> side(19200);
+//   mcpSign<28, REAR_ID> rear(19200);
+// Signs send on SERIALDEVICE unless given another transport, see Modbus_Transport.h.
+template <int Columns, byte SignId, int GapStart = 0, int GapColumns = 0>
+class mcpSign : private mcpSignStorage<Columns, mcpSignLayout<Columns, SignId, GapStart, GapColumns>::numRegisters>,
+                public mcp
+{
+  public:
+    mcpSign(int baudRate, mcpTransport &transport = mcpDefaultTransport())
+      : mcp(baudRate, transport, mcpSignLayout<Columns, SignId, GapStart, GapColumns>::layout,
+            this->frameBuffers[0], this->frameBuffers[1], this->bytestream, this->sentBytestream,
+            this->lineCacheSets())
+    {
+    }
+};
+
+// GTI Luminator MegaMax 3000 Front Sign 98x16, sign ID 6
+typedef mcpSign<98, 6, 14, 14> mcpFrontSign;
+
 #endif
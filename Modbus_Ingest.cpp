@@ -0,0 +1,167 @@
+/*
+   Frame ingest server, see Modbus_Ingest.h
+*/
+#include "Arduino.h"
+#include "Modbus_Ingest.h"
+
+// Where Receive() is in a packet
+enum
+{
+  ingestSync,    // Waiting for ingestSync0
+  ingestSync2,   // Waiting for ingestSync1
+  ingestX,
+  ingestCount,
+  ingestColumns,
+  ingestCrcLow,
+  ingestCrcHigh
+};
+
+uint16_t mcpIngestCrc(uint16_t crc, byte b)
+{
+  crc ^= (uint16_t)b << 8;
+  for (byte i = 0; i < 8; i++) {
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+mcpIngest::mcpIngest(mcp &sign, Stream &port, mcpIngestSlot *slots, byte numSlots, uint16_t *columns, int capacity)
+  : Sign(sign), Port(port)
+{
+  Ring = slots;
+  RingSize = numSlots;
+  Capacity = capacity;
+  for (byte i = 0; i < numSlots; i++) {
+    Ring[i].x = 0;
+    Ring[i].count = 0;
+    Ring[i].columns = columns + i * capacity;
+  }
+  Tail = 0;
+  Queued = 0;
+  State = ingestSync;
+  Received = 0;
+  Crc = 0xFFFF;
+  CrcLow = 0;
+  resetStats();
+}
+
+bool mcpIngest::poll()
+{
+  while (Port.available() > 0) {
+    Receive(Port.read());
+  }
+
+  Sign.tick();
+  if (Queued == 0 || Sign.isBusy()) {
+    return false;
+  }
+  Show();
+  return true;
+}
+
+void mcpIngest::Receive(byte b)
+{
+  // Columns go straight into the slot after the queued packets
+  mcpIngestSlot &slot = Ring[(Tail + Queued) % RingSize];
+  switch (State) {
+    case ingestSync:
+      if (b == ingestSync0) {
+        State = ingestSync2;
+      }
+      break;
+    case ingestSync2:
+      State = (b == ingestSync1) ? ingestX : (b == ingestSync0) ? ingestSync2 : ingestSync;
+      break;
+    case ingestX:
+      slot.x = b;
+      Crc = mcpIngestCrc(0xFFFF, b);
+      State = ingestCount;
+      break;
+    case ingestCount:
+      slot.count = b;
+      Crc = mcpIngestCrc(Crc, b);
+      if (b == 0 || slot.x + b > Capacity || slot.x + b > Sign.width()) {
+        Stats.badHeader++;
+        State = ingestSync;
+      } else {
+        Received = 0;
+        State = ingestColumns;
+      }
+      break;
+    case ingestColumns:
+      // Low byte then high byte, as in Bytestream
+      if (Received & 1) {
+        slot.columns[Received / 2] |= (uint16_t)b << 8;
+      } else {
+        slot.columns[Received / 2] = b;
+      }
+      Crc = mcpIngestCrc(Crc, b);
+      if (++Received == 2 * slot.count) {
+        State = ingestCrcLow;
+      }
+      break;
+    case ingestCrcLow:
+      CrcLow = b;
+      State = ingestCrcHigh;
+      break;
+    case ingestCrcHigh:
+      if (Crc == (CrcLow | ((uint16_t)b << 8))) {
+        Queue();
+      } else {
+        Stats.badCrc++;
+      }
+      State = ingestSync;
+      break;
+  }
+}
+
+void mcpIngest::Queue()
+{
+  // The packet just received joins the queue. A whole-sign frame hides everything
+  // queued before it, so those are dropped now. One slot is always kept free to receive into:
+  // when the ring is full the oldest packet is drawn now, as Show() would draw it first anyway,
+  // and goes out with the rest.
+  mcpIngestSlot &slot = Ring[(Tail + Queued) % RingSize];
+  Stats.packets++;
+  if (slot.x == 0 && slot.count >= Sign.width()) {
+    Stats.stale += Queued;
+    Tail = (Tail + Queued) % RingSize;
+    Queued = 0;
+  } else if (Queued == RingSize - 1) {
+    const mcpIngestSlot &oldest = Ring[Tail];
+    Sign.drawColumns(oldest.x, oldest.columns, oldest.count);
+    Tail = (Tail + 1) % RingSize;
+    Queued--;
+    Stats.overruns++;
+  }
+  Queued++;
+}
+
+void mcpIngest::Show()
+{
+  // Draw the queued packets in the order they came, and send the result
+  for (byte i = 0; i < Queued; i++) {
+    const mcpIngestSlot &slot = Ring[(Tail + i) % RingSize];
+    Sign.drawColumns(slot.x, slot.columns, slot.count);
+  }
+  Tail = (Tail + Queued) % RingSize;
+  Queued = 0;
+
+  Stats.shown++;
+  Sign.present();
+}
+
+byte mcpIngest::getQueued()
+{
+  return Queued;
+}
+
+mcpIngestStats mcpIngest::getStats()
+{
+  return Stats;
+}
+
+void mcpIngest::resetStats()
+{
+  memset(&Stats, 0, sizeof(Stats));
+}
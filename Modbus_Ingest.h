@@ -0,0 +1,125 @@
+/*
+   Frame ingest server: images streamed to the sign from a computer.
+
+   Instead of drawing in the sketch, a controller (a Linux box on the USB
+   serial port, say) sends the columns to show, already packed the way the
+   framebuffer and Bytestream are, and the sketch only forwards them:
+
+     mcpFrontSign mcp(19200);
+     mcpIngestServer<98> ingest(mcp, Serial);
+
+     void setup() {
+       Serial.begin(115200);
+       mcp.InitSign();
+     }
+     void loop() {
+       ingest.poll();
+     }
+
+   Each packet is a run of columns, the whole sign or a patch of it:
+
+     F1 D0          sync
+     x count        first column and number of columns, one byte each
+     lo hi ...      count columns, two bytes each, bit N of a column is dot N
+                    from the top (a whole front sign is the 196 bytes of its
+                    Bytestream)
+     crcLo crcHi    CRC-16/CCITT (polynomial 0x1021, starting at 0xFFFF) of
+                    x, count and the columns, see mcpIngestCrc()
+
+   Packets with a bad CRC, or columns off the sign, are dropped and counted.
+   Good ones wait in a ring of Slots packets until the sign is free, then they
+   are drawn in order and present()ed, so only the registers that changed are
+   sent. A whole-sign frame makes everything still waiting before it stale, and
+   that is dropped without being sent. If patches fill the ring up, the oldest
+   one is drawn into the framebuffer straight away and goes out with the next
+   update, so no columns are lost.
+
+   poll() never waits for the sign, it advances the update with tick(), so the
+   port is read between lines. Nothing is sent back to the controller: it can
+   send frames as fast as it likes and the sign shows the newest it can.
+   flipdot_sim serve (extras/host) runs this against the sign simulator on a pty.
+*/
+#ifndef Modbus_Ingest_h
+#define Modbus_Ingest_h
+
+#include "Arduino.h"
+#include "Modbus_CoProcessor.h"
+
+const byte ingestSync0 = 0xF1;
+const byte ingestSync1 = 0xD0;
+
+// Add one byte to a CRC-16/CCITT, start from 0xFFFF
+uint16_t mcpIngestCrc(uint16_t crc, byte b);
+
+// Packets counted since the last resetStats()
+struct mcpIngestStats
+{
+  unsigned long packets;   // Good packets received
+  unsigned long shown;     // Updates started with them
+  unsigned long stale;     // Good packets a newer whole-sign frame came in behind before they were shown
+  unsigned long overruns;  // Good packets drawn before their turn because the ring was full
+  unsigned long badCrc;
+  unsigned long badHeader; // No columns, or columns off the sign
+};
+
+// A packet received, or being received, in the ring
+struct mcpIngestSlot
+{
+  byte x;
+  byte count;
+  uint16_t *columns; // Room for the whole sign
+};
+
+class mcpIngest
+{
+  public:
+    // Read whatever the port has, and start showing the newest packets once
+    // the sign is free. True if it started an update.
+    bool poll();
+    byte getQueued(); // Good packets waiting for the sign
+    mcpIngestStats getStats();
+    void resetStats();
+
+  protected:
+    // Use mcpIngestServer, which supplies the ring
+    mcpIngest(mcp &sign, Stream &port, mcpIngestSlot *slots, byte numSlots, uint16_t *columns, int capacity);
+
+  private:
+    void Receive(byte b);
+    void Queue();
+    void Show();
+
+    mcp &Sign;
+    Stream &Port;
+    mcpIngestSlot *Ring;
+    byte RingSize;
+    int Capacity; // Columns a slot holds, the widest packet taken
+    byte Tail; // Oldest packet waiting
+    byte Queued; // Packets waiting, the slot after them is the one being received
+    byte State; // Where Receive() is in a packet, see Modbus_Ingest.cpp
+    int Received; // Bytes of columns received so far
+    uint16_t Crc;
+    byte CrcLow;
+    mcpIngestStats Stats;
+};
+
+// Ring of Slots packets, each with room for Columns columns, for mcpIngestServer
+// (see mcpSignStorage in Modbus_CoProcessor.h)
+template <int Columns, byte Slots>
+struct mcpIngestStorage
+{
+  static_assert(Slots >= 2, "One slot is always being received into");
+  static_assert(Columns <= 255, "Columns are counted in one byte");
+  mcpIngestSlot slots[Slots];
+  uint16_t columns[Slots][Columns];
+};
+
+template <int Columns, byte Slots = 3>
+class mcpIngestServer : private mcpIngestStorage<Columns, Slots>, public mcpIngest
+{
+  public:
+    mcpIngestServer(mcp &sign, Stream &port)
+      : mcpIngest(sign, port, this->slots, Slots, &this->columns[0][0], Columns) {}
+};
+
+#endif
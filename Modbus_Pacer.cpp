@@ -0,0 +1,105 @@
+/*
+   Frame pacing, see Modbus_Pacer.h
+*/
+#include "Arduino.h"
+#include "Modbus_Pacer.h"
+
+mcpPacer::mcpPacer(mcp &sign)
+  : Sign(sign)
+{
+  TargetFps = 0;
+  Started = false;
+  SecondStart = 0;
+  Slot = 0;
+  FrameNumber = 0;
+  NextFrame = 0;
+  resetStats();
+}
+
+void mcpPacer::setTargetFps(unsigned int fps)
+{
+  TargetFps = fps;
+  Started = false;
+}
+
+unsigned int mcpPacer::getTargetFps()
+{
+  return TargetFps;
+}
+
+bool mcpPacer::frameDue()
+{
+  unsigned long now = millis();
+  unsigned long ready = Sign.nextFrameDeadline();
+  if (Sign.isBusy() || (long)(now - ready) < 0) {
+    return false;
+  }
+
+  unsigned long skipped = 0;
+  if (!Started || TargetFps == 0) {
+    // The first frame of a schedule is on time whenever it comes
+    Started = true;
+    SecondStart = now;
+    Slot = 0;
+  } else {
+    // Slot n of a second starts n / TargetFps of a second in, to the ms, so nothing drifts
+    unsigned long slotStart = SecondStart + (unsigned long)Slot * 1000 / TargetFps;
+    if ((long)(now - slotStart) < 0) {
+      return false;
+    }
+    if ((long)(ready - slotStart) > 0) {
+      Stats.late++;
+    }
+    unsigned long elapsed = now - SecondStart;
+    if (elapsed >= 1000) {
+      // A second or more has gone by since the last frame (the sketch was busy elsewhere):
+      // count the slots that passed, and start the schedule again from this frame
+      skipped = (elapsed / 1000) * TargetFps + (elapsed % 1000) * TargetFps / 1000 - Slot;
+      SecondStart = now;
+      Slot = 0;
+    } else {
+      // Both are less than TargetFps, so this fits in Slot
+      unsigned int newest = elapsed * TargetFps / 1000; // Newest slot that has started
+      if (newest > Slot) {
+        skipped = newest - Slot;
+        Slot = newest;
+      }
+    }
+  }
+
+  FrameNumber = NextFrame + skipped;
+  NextFrame = FrameNumber + 1;
+  Stats.dropped += skipped;
+  Stats.frames++;
+
+  // The second moves on as its slots pass, to keep the numbers small
+  Slot++;
+  if (TargetFps != 0 && Slot >= TargetFps) {
+    Slot = 0;
+    SecondStart += 1000;
+  }
+  return true;
+}
+
+void mcpPacer::waitForFrame()
+{
+  while (!frameDue()) {
+    Sign.tick();
+    yield();
+  }
+}
+
+unsigned long mcpPacer::getFrameNumber()
+{
+  return FrameNumber;
+}
+
+mcpPacerStats mcpPacer::getStats()
+{
+  return Stats;
+}
+
+void mcpPacer::resetStats()
+{
+  memset(&Stats, 0, sizeof(Stats));
+}
@@ -0,0 +1,63 @@
+/*
+   Frame pacing: run an animation as fast as the sign takes it, or at a
+   steady frame rate, without guessing delays.
+
+   The sign works out when it can take the next frame from what it is
+   sending (see mcp::nextFrameDeadline()): the wire time of each line at the
+   baud rate, the line delays, the commit lines, the end of update delay and
+   a settle time for the dots to flip. mcpPacer waits for that, and for the
+   frame's slot when a target rate is set:
+
+     mcpPacer pacer(mcp);
+     pacer.setTargetFps(5); // 0, the default, is as fast as the sign goes
+
+     for (;;) {
+       pacer.waitForFrame(); // Or: if (pacer.frameDue()) { ... } from loop()
+       mcp.dotAllOff();
+       mcp.fillCircle(pacer.getFrameNumber() % mcp.width(), 7, 5, 1);
+       mcp.present(); // Or UpdateSign()
+     }
+
+   When the sign is still busy at a frame's slot the frame is late, and
+   slots that pass without a frame are dropped. getFrameNumber() counts
+   the dropped ones too, so an animation that draws from it keeps its speed.
+*/
+#ifndef Modbus_Pacer_h
+#define Modbus_Pacer_h
+
+#include "Arduino.h"
+#include "Modbus_CoProcessor.h"
+
+// Frames counted since the last resetStats()
+struct mcpPacerStats
+{
+  unsigned long frames;  // Frames due, on time or late
+  unsigned long late;    // Frames the sign was not ready for by their slot
+  unsigned long dropped; // Slots that passed with no frame at all
+};
+
+class mcpPacer
+{
+  public:
+    mcpPacer(mcp &sign);
+    void setTargetFps(unsigned int fps); // Starts the schedule again from the next frame
+    unsigned int getTargetFps();
+    // True once the sign can take the next frame and its slot has come. Draw and send it then.
+    bool frameDue();
+    void waitForFrame(); // Blocking frameDue(), runs the sign's tick() while it waits
+    unsigned long getFrameNumber(); // Slot of the frame last due, counting from 0
+    mcpPacerStats getStats();
+    void resetStats();
+
+  private:
+    mcp &Sign;
+    unsigned int TargetFps;
+    bool Started; // The schedule has a start, set by the first frame
+    unsigned long SecondStart; // millis() of slot 0 of the current second
+    unsigned int Slot; // Slot of the next frame within the second
+    unsigned long FrameNumber;
+    unsigned long NextFrame; // Number of the next frame, if no slot is dropped
+    mcpPacerStats Stats;
+};
+
+#endif
@@ -0,0 +1,84 @@
+/*
+   Animation pack player for the Modbus_CoProcessor library, see Modbus_Pack.h
+*/
+#include "Arduino.h"
+#include "Modbus_CoProcessor.h"
+
+static_assert(mcpPackLineLength == lineBufferSize - 1, "Pack lines must fit LineBuffer");
+
+// Number of bits set
+static byte countBits(uint16_t bits)
+{
+  byte count = 0;
+  for (; bits != 0; bits &= bits - 1) {
+    count++;
+  }
+  return count;
+}
+
+bool mcp::playFrame(const mcpPack &pack, uint16_t frame)
+{
+  // Blocking, like UpdateSign()
+  WaitUntilIdle();
+  if (!PreparePackFrame(pack, frame)) {
+    return false;
+  }
+  if (UpdateRegisters != 0) {
+    SendPrepared();
+  } else {
+    PackFrameShown = frame; // Same image as the frame before, nothing to send
+    UpdatePack = NULL;
+  }
+  return true;
+}
+
+bool mcp::beginFrame(const mcpPack &pack, uint16_t frame)
+{
+  // Returns false if an update is already running, as well as for playFrame()'s reasons
+  if (UpdateBusy || !PreparePackFrame(pack, frame)) {
+    return false;
+  }
+  if (UpdateRegisters != 0) {
+    StartSending();
+  } else {
+    PackFrameShown = frame;
+    UpdatePack = NULL;
+  }
+  return true;
+}
+
+const mcpLayout &mcp::getLayout()
+{
+  return Layout;
+}
+
+bool mcp::PreparePackFrame(const mcpPack &pack, uint16_t frame)
+{
+  // Work out which of the frame's stored lines to send. The sign has to be showing
+  // the frame before this one, or this has to be frame 0, which has every register stored.
+  if (pack.columns != Layout.columns || pack.numRegisters != Layout.numRegisters || frame >= pack.numFrames) {
+    return false;
+  }
+  memcpy_P(&UpdatePackFrame, &pack.frames[frame], sizeof(UpdatePackFrame));
+
+  uint16_t previous = (frame == 0) ? pack.numFrames - 1 : frame - 1;
+  if (PackShown == &pack && PackFrameShown == previous) {
+    UpdateRegisters = UpdatePackFrame.changed;
+  } else if (frame == 0) {
+    UpdateRegisters = UpdatePackFrame.stored;
+  } else {
+    return false;
+  }
+  UpdatePack = &pack;
+  UpdatePackIndex = frame;
+  return true;
+}
+
+const char *mcp::PackLine(byte reg)
+{
+  // Copy the stored line for one register of the pack frame into LineBuffer
+  uint16_t index = UpdatePackFrame.firstLine + countBits(UpdatePackFrame.stored & (((uint16_t)1 << reg) - 1));
+  memcpy_P(LineBuffer, UpdatePack->lines + (unsigned long)index * mcpPackLineLength, mcpPackLineLength);
+  LineBuffer[mcpPackLineLength] = '\0';
+  return LineBuffer;
+}
@@ -0,0 +1,49 @@
+/*
+   Animation packs: frames encoded ahead of time and kept in flash.
+
+   For animations and fixed route signs nothing about a frame changes from
+   one showing to the next, so the register lines, their hex and their LRCs
+   can all be worked out once, on a PC. extras/host/flipdot_pack turns a set
+   of PBM images into a header holding an mcpPack:
+
+     flipdot_pack --name arrow arrow.h arrow-0.pbm arrow-1.pbm arrow-2.pbm
+
+   and the sketch plays it with
+
+     #include "arrow.h"
+     for (uint16_t frame = 0; frame < arrow.numFrames; frame++) {
+       mcp.playFrame(arrow, frame); // Or beginFrame() and tick()
+     }
+
+   Only the registers that differ from the frame before are stored (all of
+   them for the first frame), so playing a frame copies those lines out of
+   flash and sends them, and nothing else. Frames have to be played in order,
+   starting from frame 0. After the last frame comes frame 0 again, which
+   then only sends what differs from the last frame.
+*/
+#ifndef Modbus_Pack_h
+#define Modbus_Pack_h
+
+#include "Arduino.h"
+
+// Every image register line is ':' + 20 bytes as hex + LRC, stored without a NUL
+const int mcpPackLineLength = 43;
+
+struct mcpPackFrame
+{
+  uint16_t stored;    // Registers with a line stored for this frame, one bit per register
+  uint16_t changed;   // Registers that differ from the frame before (the last frame, for frame 0)
+  uint16_t firstLine; // Index in lines of the first one stored for this frame, in register order
+};
+
+// Made by flipdot_pack. The frames and lines are in flash (PROGMEM), this struct is not.
+struct mcpPack
+{
+  int columns;                // Sign the pack was made for, must match the one playing it
+  byte numRegisters;
+  uint16_t numFrames;
+  const mcpPackFrame *frames; // numFrames entries
+  const char *lines;          // mcpPackLineLength chars each
+};
+
+#endif
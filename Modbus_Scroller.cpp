@@ -0,0 +1,91 @@
+/*
+   Pre-rendered strip of columns for scrolling text, see Modbus_Scroller.h
+*/
+#include "Arduino.h"
+#include "Modbus_Scroller.h"
+
+mcpStrip::mcpStrip(uint16_t *columns, int16_t capacity)
+  : Adafruit_GFX(capacity, ySize)
+{
+  Strip = columns;
+  Capacity = capacity;
+  Gap = 0;
+  setTextWrap(false); // One long line
+  setTextColor(1);
+  clear();
+}
+
+void mcpStrip::drawPixel(int16_t x, int16_t y, uint16_t color)
+{
+  // Same colors as mcp::drawPixel(), 1 is dot on
+  if ((x < 0) || (x >= width()) || (y < 0) || (y >= height()))
+    return;
+
+  if (color == 1) {
+    Strip[x] |= (uint16_t)1 << y;
+    if (x >= Used) {
+      Used = x + 1;
+    }
+  } else {
+    Strip[x] &= ~((uint16_t)1 << y);
+  }
+}
+
+void mcpStrip::clear()
+{
+  memset(Strip, 0, Capacity * sizeof(uint16_t));
+  Used = 0;
+  setCursor(0, getCursorY());
+}
+
+void mcpStrip::setGap(int16_t columns)
+{
+  Gap = (columns > 0) ? columns : 0;
+}
+
+int16_t mcpStrip::getLength()
+{
+  // The cursor has moved past the last character's spacing, which counts too
+  int16_t text = (getCursorX() > Used) ? getCursorX() : Used;
+  if (text > Capacity) {
+    text = Capacity;
+  }
+  int16_t length = text + Gap;
+  return (length > 0) ? length : 1;
+}
+
+const uint16_t *mcpStrip::getColumns()
+{
+  return Strip;
+}
+
+void mcpStrip::drawTo(mcp &sign, long offset, int16_t x, int16_t length)
+{
+  // Strip past the end of the text are the gap, and are blank
+  if (length < 0) {
+    length = sign.width() - x;
+  }
+  int16_t lap = getLength();
+  int16_t text = lap - Gap;
+  int16_t from = offset % lap;
+  if (from < 0) {
+    from += lap;
+  }
+
+  while (length > 0) {
+    int16_t run;
+    if (from < text) {
+      run = (text - from < length) ? text - from : length;
+      sign.drawColumns(x, &Strip[from], run);
+    } else {
+      run = (lap - from < length) ? lap - from : length;
+      sign.fillRect(x, 0, run, ySize, 0);
+    }
+    x += run;
+    length -= run;
+    from += run;
+    if (from >= lap) {
+      from = 0; // Round to the start of the text again
+    }
+  }
+}
@@ -0,0 +1,67 @@
+/*
+   Pre-rendered strip of columns for scrolling text.
+
+   Text is drawn once with Adafruit_GFX into an off-screen strip, kept in the
+   same one word per column packing as the sign's framebuffer. Each scroll
+   step then copies a window of the strip to the sign, so no glyph is drawn
+   again while it moves:
+
+     mcpScrollStrip<400> strip;
+     strip.setFont(&FreeMonoBold9pt7b);
+     strip.setCursor(0, 13);
+     strip.print("Downtown via Main St");
+     strip.setGap(30); // Blank columns before the text comes round again
+
+     for (int offset = 0; ; offset++) {
+       strip.drawTo(mcp, offset);
+       mcp.UpdateSign(); // Only the registers that changed are sent
+     }
+
+   The strip wraps around, so any offset works and the text comes back in
+   from the right after the gap. Text past the end of the strip is clipped.
+*/
+#ifndef Modbus_Scroller_h
+#define Modbus_Scroller_h
+
+#include "Arduino.h"
+#include <Adafruit_GFX.h>
+#include "Modbus_CoProcessor.h"
+
+class mcpStrip : public Adafruit_GFX
+{
+  public:
+    void drawPixel(int16_t x, int16_t y, uint16_t color);
+    void clear(); // Blank the strip and move the cursor back to the first column
+    void setGap(int16_t columns);
+    int16_t getLength(); // Columns in one lap: the text drawn so far plus the gap
+    // Copy Length columns from offset (wrapping round) to columns x onward of the sign.
+    // A negative length means the rest of the sign.
+    void drawTo(mcp &sign, long offset, int16_t x = 0, int16_t length = -1);
+    const uint16_t *getColumns();
+
+  protected:
+    // Use mcpScrollStrip, which supplies the columns
+    mcpStrip(uint16_t *columns, int16_t capacity);
+
+  private:
+    uint16_t *Strip; // One word per column, bit N is dot N from the top
+    int16_t Capacity;
+    int16_t Used; // Columns the text reaches, the cursor or the last dot drawn, whichever is further
+    int16_t Gap;
+};
+
+// A strip Columns long, for mcpScrollStrip (see mcpSignStorage in Modbus_CoProcessor.h)
+template <int Columns>
+struct mcpStripStorage
+{
+  uint16_t columns[Columns];
+};
+
+template <int Columns>
+class mcpScrollStrip : private mcpStripStorage<Columns>, public mcpStrip
+{
+  public:
+    mcpScrollStrip() : mcpStrip(this->columns, Columns) {}
+};
+
+#endif
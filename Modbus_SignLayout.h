@@ -0,0 +1,198 @@
+/*
+   Compile time description of a Luminator sign: its register map and the
+   fixed command lines, with their LRCs, for a given size and sign ID.
+
+   Nothing in here runs on the board, the compiler works it all out and
+   leaves constant tables behind. See mcpSign in Modbus_CoProcessor.h.
+*/
+#ifndef Modbus_SignLayout_h
+#define Modbus_SignLayout_h
+
+#include "Arduino.h"
+
+const int mcpImageHeaderSize = 4; // Fixed header at the start of register 0
+const int mcpRegisterSize = 16;   // Data bytes in each image register line
+
+// Describes how one 16 byte image register is filled.
+// Every register is sent as ":10" + "00" + address + "00" + 16 bytes + LRC,
+// the 16 bytes being: image header, zeros, Bytestream data, zeros (in that order).
+struct mcpRegister
+{
+  byte address;     // Low address byte on the wire (R0 = 0x00, R1 = 0x10 ... RE = 0xE0)
+  byte headerBytes; // Number of fixed image header bytes at the start (R0 only)
+  byte leadZeros;   // Zero padding before the data
+  int start;        // First Bytestream byte carried by this register
+  byte count;       // Number of Bytestream bytes carried by this register
+  byte tailZeros;   // Zero padding after the data
+};
+
+// Everything the driver needs to know about one sign.
+// Filled in at compile time by mcpSignLayout, the driver only reads it.
+struct mcpLayout
+{
+  int columns;                    // Dots across
+  int byteStreamSize;             // Bytes of image data, two per column
+  byte numRegisters;              // Image registers sent for a full image
+  const mcpRegister *registers;   // Register map, numRegisters entries
+  const char *selectLine;         // Tells the sign we are about to send a new image
+  const char *const *commitLines; // Tells the sign to display the image
+  byte numCommitLines;
+  const char *const *initLines;   // InitSign()
+  byte numInitLines;
+  const char *const *closeLines;  // CloseSign()
+  byte numCloseLines;
+};
+
+// Small constexpr helpers. These have to stay single return statements for C++11.
+
+constexpr int mcpMin(int a, int b) { return a < b ? a : b; }
+constexpr int mcpMax(int a, int b) { return a > b ? a : b; }
+
+// Image registers needed for the header and 2 bytes per controller column
+constexpr int mcpRegisterCount(int controllerColumns)
+{
+  return (mcpImageHeaderSize + 2 * controllerColumns + mcpRegisterSize - 1) / mcpRegisterSize;
+}
+
+// Register reg covers controller memory [16 * reg, 16 * reg + 16), and carries
+// image data from [runStart, runEnd) of that, which starts at Bytestream[streamStart].
+constexpr mcpRegister mcpRegisterRun(int reg, int runStart, int runEnd, int streamStart)
+{
+  return runEnd > runStart
+    ? mcpRegister{(byte)(mcpRegisterSize * reg), (byte)(reg == 0 ? mcpImageHeaderSize : 0),
+                  (byte)(runStart - mcpRegisterSize * reg - (reg == 0 ? mcpImageHeaderSize : 0)), streamStart,
+                  (byte)(runEnd - runStart), (byte)(mcpRegisterSize * (reg + 1) - runEnd)}
+    : mcpRegister{(byte)(mcpRegisterSize * reg), (byte)(reg == 0 ? mcpImageHeaderSize : 0),
+                  (byte)(mcpRegisterSize - (reg == 0 ? mcpImageHeaderSize : 0)), 0, 0, 0}; // Totally blank
+}
+
+// The controller memory is the image header, then 2 bytes per column. Columns
+// [gapStart, gapStart + gapColumns) have no dots on the sign and are sent as zeros,
+// so a register carries data from before the gap, or after it, or none at all.
+constexpr mcpRegister mcpRegisterAt(int reg, int columns, int gapStart, int gapColumns)
+{
+  return mcpMin(mcpRegisterSize * (reg + 1), mcpImageHeaderSize + 2 * gapStart) > mcpMax(mcpRegisterSize * reg, mcpImageHeaderSize)
+    ? mcpRegisterRun(reg,
+                     mcpMax(mcpRegisterSize * reg, mcpImageHeaderSize),
+                     mcpMin(mcpRegisterSize * (reg + 1), mcpImageHeaderSize + 2 * gapStart),
+                     mcpMax(mcpRegisterSize * reg, mcpImageHeaderSize) - mcpImageHeaderSize)
+    : mcpRegisterRun(reg,
+                     mcpMax(mcpRegisterSize * reg, mcpImageHeaderSize + 2 * (gapStart + gapColumns)),
+                     mcpMin(mcpRegisterSize * (reg + 1), mcpImageHeaderSize + 2 * (columns + gapColumns)),
+                     mcpMax(mcpRegisterSize * reg, mcpImageHeaderSize + 2 * (gapStart + gapColumns)) - mcpImageHeaderSize - 2 * gapColumns);
+}
+
+// Sum of the bytes of a line, the LRC is the two's complement of this
+constexpr byte mcpSum() { return 0; }
+template <typename... Rest>
+constexpr byte mcpSum(byte first, Rest... rest) { return (byte)(first + mcpSum(rest...)); }
+
+// Byte n of a list
+constexpr byte mcpNth(int) { return 0; }
+template <typename... Rest>
+constexpr byte mcpNth(int n, byte first, Rest... rest) { return n == 0 ? first : mcpNth(n - 1, rest...); }
+
+constexpr char mcpHexDigit(int nibble) { return (char)(nibble < 10 ? '0' + nibble : 'A' + nibble - 10); }
+
+// 0, 1 ... N-1 as a parameter pack, for building tables
+template <int... Is> struct mcpIndices {};
+template <int N, int... Is> struct mcpMakeIndices : mcpMakeIndices<N - 1, N - 1, Is...> {};
+template <int... Is> struct mcpMakeIndices<0, Is...> { typedef mcpIndices<Is...> type; };
+
+// The text of a command line, ':' then each byte and the LRC as two hex digits
+template <typename Indices, byte... Bytes> struct mcpFrameText;
+template <int... Is, byte... Bytes>
+struct mcpFrameText<mcpIndices<Is...>, Bytes...>
+{
+  static constexpr char text[] = {
+    ':',
+    mcpHexDigit((Is & 1) ? mcpNth(Is / 2, Bytes..., (byte)(0 - mcpSum(Bytes...))) & 0x0F
+                         : mcpNth(Is / 2, Bytes..., (byte)(0 - mcpSum(Bytes...))) >> 4)...,
+    '\0'
+  };
+};
+template <int... Is, byte... Bytes>
+constexpr char mcpFrameText<mcpIndices<Is...>, Bytes...>::text[];
+
+// A fixed command line, e.g. mcpFrame<0x01, 0x00, 0x06, 0x03, 0xA2>::text is ":01000603A254"
+template <byte... Bytes>
+struct mcpFrame : mcpFrameText<typename mcpMakeIndices<2 * (sizeof...(Bytes) + 1)>::type, Bytes...> {};
+
+// The register map, one mcpRegisterAt() per register
+template <typename Indices, int Columns, int GapStart, int GapColumns> struct mcpRegisterTable;
+template <int Columns, int GapStart, int GapColumns, int... Is>
+struct mcpRegisterTable<mcpIndices<Is...>, Columns, GapStart, GapColumns>
+{
+  static constexpr mcpRegister registers[sizeof...(Is)] = {mcpRegisterAt(Is, Columns, GapStart, GapColumns)...};
+};
+template <int Columns, int GapStart, int GapColumns, int... Is>
+constexpr mcpRegister mcpRegisterTable<mcpIndices<Is...>, Columns, GapStart, GapColumns>::registers[sizeof...(Is)];
+
+// Layout of a sign Columns dots across, answering to SignId.
+// Some signs use less of the controller than it has room for, e.g. the 98x16 front sign
+// is missing 14 columns after column 13: that is GapStart = 14, GapColumns = 14.
+template <int Columns, byte SignId, int GapStart = 0, int GapColumns = 0>
+struct mcpSignLayout
+{
+  static_assert(Columns > 0, "A sign needs at least one column");
+  static_assert(GapStart >= 0 && GapStart <= Columns, "The gap must start inside the sign");
+  static_assert(GapColumns == 0 || GapColumns >= 8, "Each register can only carry data from one side of the gap");
+  static_assert(mcpRegisterCount(Columns + GapColumns) <= 16, "Image registers 0 thru F are all there is");
+
+  static constexpr int numRegisters = mcpRegisterCount(Columns + GapColumns);
+  typedef mcpRegisterTable<typename mcpMakeIndices<numRegisters>::type,
+                           Columns, GapColumns ? GapStart : Columns, GapColumns> Registers;
+
+  static const char *const commitLines[5];
+  static const char *const initLines[6];
+  static const char *const closeLines[5];
+  static const mcpLayout layout;
+};
+
+template <int Columns, byte SignId, int GapStart, int GapColumns>
+constexpr int mcpSignLayout<Columns, SignId, GapStart, GapColumns>::numRegisters;
+
+template <int Columns, byte SignId, int GapStart, int GapColumns>
+const char *const mcpSignLayout<Columns, SignId, GapStart, GapColumns>::commitLines[5] = {
+  mcpFrame<0x00, 0x00, 0x0F, 0x01>::text,
+  mcpFrame<0x01, 0x00, SignId, 0x02, 0x00>::text,
+  mcpFrame<0x01, 0x00, SignId, 0x06, 0x00>::text,
+  mcpFrame<0x01, 0x00, SignId, 0x02, 0x00>::text,
+  mcpFrame<0x01, 0x00, SignId, 0x03, 0xA9>::text,
+};
+
+// Addresses 0x05 and 0x7F below are the same for every sign, and the configuration
+// record is the one captured from the front sign.
+template <int Columns, byte SignId, int GapStart, int GapColumns>
+const char *const mcpSignLayout<Columns, SignId, GapStart, GapColumns>::initLines[6] = {
+  mcpFrame<0x01, 0x00, 0x05, 0x02, 0xFF>::text,
+  mcpFrame<0x01, 0x00, SignId, 0x02, 0xFF>::text,
+  mcpFrame<0x01, 0x00, SignId, 0x03, 0xA1>::text,
+  mcpFrame<0x10, 0x00, 0x00, 0x00, 0x04, 0x47, 0x00, 0x0F, 0x10, 0x1C, 0x1C, 0x1C, 0x1C, 0x10,
+           0x00, 0x00, 0x00, 0x00, 0x00, 0x00>::text,
+  mcpFrame<0x00, 0x00, 0x01, 0x01>::text,
+  mcpFrame<0x01, 0x00, SignId, 0x02, 0x00>::text,
+};
+
+template <int Columns, byte SignId, int GapStart, int GapColumns>
+const char *const mcpSignLayout<Columns, SignId, GapStart, GapColumns>::closeLines[5] = {
+  mcpFrame<0x01, 0x00, SignId, 0x03, 0xA9>::text,
+  mcpFrame<0x01, 0x00, SignId, 0x03, 0xAA>::text,
+  mcpFrame<0x01, 0x00, 0x7F, 0x02, 0xFF>::text,
+  mcpFrame<0x01, 0x00, SignId, 0x02, 0x55>::text,
+  mcpFrame<0x01, 0x00, SignId, 0x03, 0xA6>::text,
+};
+
+template <int Columns, byte SignId, int GapStart, int GapColumns>
+const mcpLayout mcpSignLayout<Columns, SignId, GapStart, GapColumns>::layout = {
+  Columns,
+  2 * Columns,
+  numRegisters,
+  Registers::registers,
+  mcpFrame<0x01, 0x00, SignId, 0x03, 0xA2>::text,
+  commitLines, 5,
+  initLines, 6,
+  closeLines, 5,
+};
+
+#endif
@@ -0,0 +1,201 @@
+/*
+   Text drawing for the Modbus_CoProcessor library.
+
+   Adafruit_GFX draws text a dot at a time: every lit dot of a glyph is a
+   call to drawPixel(), and at text size 2 or more every dot is a fillRect()
+   made of drawPixel() calls. The framebuffer keeps one word per column, so
+   here a glyph is turned into one mask per column instead, scaled up by
+   repeating bits (rows) and masks (columns), and each mask is ORed into the
+   framebuffer in one go.
+
+   The classic 5x7 font is already stored a column per byte, with the top
+   dot in the least significant bit like the framebuffer, so its columns are
+   used as they are. GFXfont glyphs are stored a row at a time and are
+   turned into columns as they are drawn.
+
+   Cursor movement, wrapping, colors and clipping are the same as
+   Adafruit_GFX::write(). Anything this does not handle (a rotated display,
+   or a glyph more than 32 dots tall or wide once scaled) is handed to
+   Adafruit_GFX::drawChar(). Set MCP_NATIVE_TEXT to 0 to always use it.
+*/
+#include "Arduino.h"
+#include "Modbus_CoProcessor.h"
+
+#if MCP_NATIVE_TEXT
+
+// Adafruit_GFX keeps its classic font to itself, so this file has its own copy
+#include <glcdfont.c>
+
+const int maxGlyphDots = 32; // Tallest and widest glyph, scaled, that fits the column masks
+
+// Dots 0 thru n-1 set
+static inline uint32_t lowDots(int n)
+{
+  return (n >= 32) ? 0xFFFFFFFFUL : (((uint32_t)1 << n) - 1);
+}
+
+// Repeat every bit of a glyph column size times, so each dot becomes size dots tall
+static uint32_t scaleColumn(uint32_t dots, uint8_t size)
+{
+  if (size == 1) {
+    return dots;
+  }
+  uint32_t scaled = 0;
+  uint32_t block = lowDots(size);
+  for (int bit = 0; dots != 0; bit++, dots >>= 1) {
+    if (dots & 1) {
+      scaled |= block << (bit * size);
+    }
+  }
+  return scaled;
+}
+
+size_t mcp::write(uint8_t c)
+{
+  // Same as Adafruit_GFX::write(), with the drawing done here
+  if (getRotation() != 0) {
+    return Adafruit_GFX::write(c);
+  }
+
+  if (!gfxFont) {
+    if (c == '\n') {
+      cursor_x = 0;
+      cursor_y += textsize_y * 8;
+    } else if (c != '\r') {
+      if (wrap && ((cursor_x + textsize_x * 6) > _width)) {
+        cursor_x = 0;
+        cursor_y += textsize_y * 8;
+      }
+      if (!DrawClassicChar(cursor_x, cursor_y, c)) {
+        drawChar(cursor_x, cursor_y, c, textcolor, textbgcolor, textsize_x, textsize_y);
+      }
+      cursor_x += textsize_x * 6;
+    }
+    return 1;
+  }
+
+  if (c == '\n') {
+    cursor_x = 0;
+    cursor_y += (int16_t)textsize_y * (uint8_t)pgm_read_byte(&gfxFont->yAdvance);
+  } else if (c != '\r') {
+    uint8_t first = pgm_read_byte(&gfxFont->first);
+    if ((c >= first) && (c <= (uint8_t)pgm_read_byte(&gfxFont->last))) {
+      GFXglyph *glyph = &(((GFXglyph *)pgm_read_ptr(&gfxFont->glyph))[c - first]);
+      uint8_t w = pgm_read_byte(&glyph->width);
+      uint8_t h = pgm_read_byte(&glyph->height);
+      if ((w > 0) && (h > 0)) {
+        int16_t xo = (int8_t)pgm_read_byte(&glyph->xOffset);
+        if (wrap && ((cursor_x + textsize_x * (xo + w)) > _width)) {
+          cursor_x = 0;
+          cursor_y += (int16_t)textsize_y * (uint8_t)pgm_read_byte(&gfxFont->yAdvance);
+        }
+        if (!DrawFontChar(cursor_x, cursor_y, c)) {
+          drawChar(cursor_x, cursor_y, c, textcolor, textbgcolor, textsize_x, textsize_y);
+        }
+      }
+      cursor_x += (uint8_t)pgm_read_byte(&glyph->xAdvance) * (int16_t)textsize_x;
+    }
+  }
+  return 1;
+}
+
+bool mcp::DrawClassicChar(int16_t x, int16_t y, unsigned char c)
+{
+  // A 6x8 cell: five columns of the font and a blank one, each textsize_x wide.
+  // The background color is only drawn if it differs from the text color.
+  if (8 * textsize_y > maxGlyphDots) {
+    return false;
+  }
+  if ((x >= _width) || (y >= _height) || ((x + 6 * textsize_x - 1) < 0) || ((y + 8 * textsize_y - 1) < 0)) {
+    return true; // Nothing of it is on the sign
+  }
+  if (!_cp437 && (c >= 176)) {
+    c++; // Same quirk as Adafruit_GFX, for compatibility with old sketches
+  }
+
+  uint32_t cell = (textbgcolor != textcolor) ? lowDots(8 * textsize_y) : 0;
+  for (int8_t i = 0; i < 6; i++) {
+    uint32_t dots = (i < 5) ? scaleColumn(pgm_read_byte(&font[c * 5 + i]), textsize_y) : 0;
+    for (uint8_t dx = 0; dx < textsize_x; dx++) {
+      DrawGlyphColumn(x + i * textsize_x + dx, y, dots, cell);
+    }
+  }
+  return true;
+}
+
+bool mcp::DrawFontChar(int16_t x, int16_t y, unsigned char c)
+{
+  // GFXfont glyphs are rows of bits, packed one after the other with no padding.
+  // Gather them into a mask per glyph column first. GFXfont text has no background.
+  c -= (uint8_t)pgm_read_byte(&gfxFont->first);
+  GFXglyph *glyph = &(((GFXglyph *)pgm_read_ptr(&gfxFont->glyph))[c]);
+  uint8_t *bitmap = (uint8_t *)pgm_read_ptr(&gfxFont->bitmap);
+  uint16_t offset = pgm_read_word(&glyph->bitmapOffset);
+  uint8_t w = pgm_read_byte(&glyph->width);
+  uint8_t h = pgm_read_byte(&glyph->height);
+  int8_t xo = pgm_read_byte(&glyph->xOffset);
+  int8_t yo = pgm_read_byte(&glyph->yOffset);
+  if (w > maxGlyphDots || h * textsize_y > maxGlyphDots) {
+    return false;
+  }
+
+  uint32_t columns[maxGlyphDots];
+  memset(columns, 0, w * sizeof(uint32_t));
+  uint8_t bits = 0;
+  uint8_t bit = 0;
+  for (uint8_t yy = 0; yy < h; yy++) {
+    for (uint8_t xx = 0; xx < w; xx++) {
+      if (!(bit++ & 7)) {
+        bits = pgm_read_byte(&bitmap[offset++]);
+      }
+      if (bits & 0x80) {
+        columns[xx] |= (uint32_t)1 << yy;
+      }
+      bits <<= 1;
+    }
+  }
+
+  int16_t top = y + yo * textsize_y;
+  for (uint8_t xx = 0; xx < w; xx++) {
+    if (columns[xx] == 0) {
+      continue;
+    }
+    uint32_t dots = scaleColumn(columns[xx], textsize_y);
+    for (uint8_t dx = 0; dx < textsize_x; dx++) {
+      DrawGlyphColumn(x + (xo + xx) * textsize_x + dx, top, dots, 0);
+    }
+  }
+  return true;
+}
+
+void mcp::DrawGlyphColumn(int16_t x, int16_t y, uint32_t dots, uint32_t cell)
+{
+  // Draw one column of a glyph with its top at y: dots in the text color,
+  // and the rest of cell in the background color. Color 1 is dot on, as in drawPixel().
+  if (x < 0 || x >= _width || y >= _height || y <= -maxGlyphDots) {
+    return;
+  }
+  uint32_t background = cell & ~dots;
+  if (y >= 0) {
+    dots <<= y;
+    background <<= y;
+  } else {
+    dots >>= -y;
+    background >>= -y;
+  }
+
+  uint16_t column = Framebuffer[x];
+  if (textbgcolor == 1) {
+    column |= (uint16_t)background;
+  } else {
+    column &= ~(uint16_t)background;
+  }
+  if (textcolor == 1) {
+    column |= (uint16_t)dots;
+  } else {
+    column &= ~(uint16_t)dots;
+  }
+  Framebuffer[x] = column;
+}
+
+#endif
@@ -0,0 +1,117 @@
+/*
+   Transports for the Modbus_CoProcessor library, see Modbus_Transport.h
+*/
+#include "Arduino.h"
+#include "Modbus_Transport.h"
+
+void mcpTransport::begin(unsigned long baudRate)
+{
+  BaudRate = baudRate;
+}
+
+unsigned long mcpTransport::wireMicros(size_t bytes)
+{
+  return (bytes * 10000000UL) / BaudRate;
+}
+
+mcpSerialTransport::mcpSerialTransport(HardwareSerial &port)
+  : Port(port)
+{
+  BaudRate = 9600;
+}
+
+void mcpSerialTransport::begin(unsigned long baudRate)
+{
+  mcpTransport::begin(baudRate);
+  Port.begin(baudRate);
+}
+
+void mcpSerialTransport::writeLine(const char *line, size_t length)
+{
+  // Returns as soon as the line is copied into the port's transmit buffer when the buffer holds
+  // a whole line (45 bytes with CRLF). On cores with a smaller one, e.g. Serial3 on Teensy 3.x,
+  // write() blocks briefly until the rest fits.
+  Port.write((const uint8_t *)line, length);
+  Port.write((const uint8_t *)"\r\n", 2); // CRLF, good for modbus
+}
+
+int mcpSerialTransport::available()
+{
+  return Port.available();
+}
+
+int mcpSerialTransport::read()
+{
+  return Port.read();
+}
+
+void mcpSerialTransport::flush()
+{
+  Port.flush();
+}
+
+mcpLoopbackTransport::mcpLoopbackTransport()
+{
+  BaudRate = 9600;
+  LineListener = NULL;
+  ListenerContext = NULL;
+  ReceiveHead = 0;
+  ReceiveTail = 0;
+  linesWritten = 0;
+  bytesWritten = 0;
+}
+
+void mcpLoopbackTransport::setListener(Listener listener, void *context)
+{
+  LineListener = listener;
+  ListenerContext = context;
+}
+
+bool mcpLoopbackTransport::receive(const uint8_t *data, size_t size)
+{
+  for (size_t i = 0; i < size; i++) {
+    int next = (ReceiveHead + 1) % loopbackReceiveSize;
+    if (next == ReceiveTail) {
+      return false; // Full, the rest is dropped
+    }
+    Received[ReceiveHead] = data[i];
+    ReceiveHead = next;
+  }
+  return true;
+}
+
+void mcpLoopbackTransport::writeLine(const char *line, size_t length)
+{
+  linesWritten++;
+  bytesWritten += length + 2;
+  if (LineListener != NULL) {
+    LineListener(ListenerContext, (const uint8_t *)line, length);
+    LineListener(ListenerContext, (const uint8_t *)"\r\n", 2);
+  }
+}
+
+int mcpLoopbackTransport::available()
+{
+  return (ReceiveHead - ReceiveTail + loopbackReceiveSize) % loopbackReceiveSize;
+}
+
+int mcpLoopbackTransport::read()
+{
+  if (ReceiveHead == ReceiveTail) {
+    return -1;
+  }
+  uint8_t c = Received[ReceiveTail];
+  ReceiveTail = (ReceiveTail + 1) % loopbackReceiveSize;
+  return c;
+}
+
+void mcpLoopbackTransport::flush()
+{
+  // Nothing is ever waiting to go out
+}
+
+mcpTransport &mcpDefaultTransport()
+{
+  static mcpSerialTransport transport(SERIALDEVICE);
+  return transport;
+}
@@ -0,0 +1,89 @@
+/*
+   Transports: where the driver's lines go, and where the sign's answers
+   come from.
+
+   mcp talks to the sign through an mcpTransport handed to its constructor.
+   By default that is the serial port SERIALDEVICE, as it always was:
+
+     mcpFrontSign front(19200);                      // SERIALDEVICE (Serial3)
+     mcpSerialTransport rs485(Serial1);
+     mcpFrontSign front(19200, rs485);               // Another port
+
+   The transport is given whole lines, so a backend can send each one as a
+   single write (the termios backend in extras/host does). It says how long
+   a number of bytes spends on the wire, which the driver uses to time its
+   line delays instead of waiting on the port. The profile's writeMicros
+   (see getProfile()) is the time spent in writeLine(), so a transport's own
+   cost can be measured apart from encoding.
+
+   mcpLoopbackTransport keeps everything in memory: lines go to a listener
+   (a sign simulator, a test), and answers are queued with receive().
+*/
+#ifndef Modbus_Transport_h
+#define Modbus_Transport_h
+
+#include "Arduino.h"
+
+#ifndef SERIALDEVICE
+#define SERIALDEVICE Serial3 // Default port, it should be connected to an RS485 converter
+#endif
+
+class mcpTransport
+{
+  public:
+    virtual ~mcpTransport() {}
+    virtual void begin(unsigned long baudRate);
+    virtual void writeLine(const char *line, size_t length) = 0; // Sends line and CRLF, may return before they are out
+    virtual int available() = 0; // Answer bytes ready to read
+    virtual int read() = 0; // -1 if there is nothing to read
+    virtual void flush() = 0; // Wait until everything written has been sent
+    virtual unsigned long wireMicros(size_t bytes); // 1 start, 8 data and 1 stop bit per byte, by default
+
+  protected:
+    unsigned long BaudRate;
+};
+
+// An Arduino serial port, sending from its transmit buffer in the background
+class mcpSerialTransport : public mcpTransport
+{
+  public:
+    mcpSerialTransport(HardwareSerial &port);
+    void begin(unsigned long baudRate);
+    void writeLine(const char *line, size_t length);
+    int available();
+    int read();
+    void flush();
+
+  private:
+    HardwareSerial &Port;
+};
+
+const int loopbackReceiveSize = 64; // Answer bytes an mcpLoopbackTransport holds
+
+// Lines go to a listener, answers are whatever receive() queued
+class mcpLoopbackTransport : public mcpTransport
+{
+  public:
+    typedef void (*Listener)(void *context, const uint8_t *data, size_t size);
+    mcpLoopbackTransport();
+    void setListener(Listener listener, void *context); // Called with each line, then with its CRLF
+    bool receive(const uint8_t *data, size_t size); // False if they did not all fit
+    void writeLine(const char *line, size_t length);
+    int available();
+    int read();
+    void flush();
+    unsigned long linesWritten;
+    unsigned long bytesWritten;
+
+  private:
+    Listener LineListener;
+    void *ListenerContext;
+    uint8_t Received[loopbackReceiveSize];
+    int ReceiveHead;
+    int ReceiveTail;
+};
+
+// A transport on SERIALDEVICE, shared by every sign not given one
+mcpTransport &mcpDefaultTransport();
+
+#endif
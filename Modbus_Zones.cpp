@@ -0,0 +1,202 @@
+/*
+   Content zones, see Modbus_Zones.h
+*/
+#include "Arduino.h"
+#include "Modbus_Zones.h"
+
+mcpZone::mcpZone(uint16_t *columns, int16_t x, int16_t y, int16_t w, int16_t h, const char *name)
+  : Adafruit_GFX(w, h)
+{
+  Columns = columns;
+  X = x;
+  Y = y;
+  Mask = 0;
+  for (int16_t row = y; row < y + h; row++) {
+    if (row >= 0 && row < ySize) {
+      Mask |= (uint16_t)1 << row;
+    }
+  }
+  Name = name;
+  Render = NULL;
+  Interval = 0;
+  RenderedAt = 0;
+  RenderDue = false;
+  Changed = false;
+  setTextWrap(false);
+  setTextColor(1);
+  memset(Columns, 0, w * sizeof(uint16_t));
+}
+
+void mcpZone::drawPixel(int16_t x, int16_t y, uint16_t color)
+{
+  // Same colors as mcp::drawPixel(), 1 is dot on. Dots outside the zone are clipped.
+  if ((x < 0) || (x >= width()) || (y < 0) || (y >= height()))
+    return;
+
+  int16_t row = y + Y;
+  if (row < 0 || row >= ySize)
+    return;
+
+  if (color == 1) {
+    Columns[x] |= (uint16_t)1 << row;
+  } else {
+    Columns[x] &= ~((uint16_t)1 << row);
+  }
+  Changed = true;
+}
+
+void mcpZone::fillScreen(uint16_t color)
+{
+  // The whole zone, a column word at a time
+  uint16_t fill = (color == 1) ? Mask : 0;
+  for (int16_t x = 0; x < width(); x++) {
+    Columns[x] = fill;
+  }
+  Changed = true;
+}
+
+void mcpZone::setRefresh(unsigned long intervalMs, void (*render)(mcpZone &zone))
+{
+  Interval = intervalMs;
+  Render = render;
+  RenderDue = (render != NULL); // Drawn for the first time at the next tick()
+}
+
+void mcpZone::invalidate()
+{
+  if (Render != NULL) {
+    RenderDue = true;
+  } else {
+    Changed = true;
+  }
+}
+
+bool mcpZone::isChanged()
+{
+  return Changed;
+}
+
+const char *mcpZone::getName()
+{
+  return Name;
+}
+
+int16_t mcpZone::getX()
+{
+  return X;
+}
+
+int16_t mcpZone::getY()
+{
+  return Y;
+}
+
+mcpZones::mcpZones(mcp &sign)
+  : Sign(sign)
+{
+  NumZones = 0;
+  Updates = 0;
+  RegistersSent = 0;
+}
+
+bool mcpZones::add(mcpZone &zone)
+{
+  if (NumZones >= zonesMaxZones) {
+    return false;
+  }
+  Zones[NumZones++] = &zone;
+  return true;
+}
+
+mcpZone *mcpZones::find(const char *name)
+{
+  for (byte i = 0; i < NumZones; i++) {
+    if (Zones[i]->Name != NULL && strcmp(Zones[i]->Name, name) == 0) {
+      return Zones[i];
+    }
+  }
+  return NULL;
+}
+
+bool mcpZones::tick()
+{
+  Sign.tick();
+
+  // Zones render whenever they are due, even while the sign is sending: they draw into their own columns
+  unsigned long now = millis();
+  for (byte i = 0; i < NumZones; i++) {
+    mcpZone &zone = *Zones[i];
+    if (zone.Render != NULL &&
+        (zone.RenderDue || (zone.Interval != 0 && now - zone.RenderedAt >= zone.Interval))) {
+      zone.RenderDue = false;
+      zone.RenderedAt = now;
+      zone.Render(zone);
+    }
+  }
+  if (Sign.isBusy()) {
+    return false; // The changed zones go out together once it is done
+  }
+
+  // Copy in the zones that came out different from the framebuffer, and pick their registers
+  uint16_t registers = 0;
+  const uint16_t *shown = Sign.getColumns();
+  for (byte i = 0; i < NumZones; i++) {
+    mcpZone &zone = *Zones[i];
+    if (!zone.Changed) {
+      continue;
+    }
+    zone.Changed = false;
+    int16_t first = (zone.X < 0) ? -zone.X : 0;
+    int16_t end = (zone.width() < Sign.width() - zone.X) ? zone.width() : Sign.width() - zone.X;
+    bool differs = false;
+    for (int16_t c = first; c < end && !differs; c++) {
+      differs = (shown[zone.X + c] & zone.Mask) != zone.Columns[c];
+    }
+    if (!differs) {
+      continue;
+    }
+    Sign.fillRect(zone.X, zone.Y, zone.width(), zone.height(), 0);
+    Sign.drawColumns(zone.X, zone.Columns, zone.width(), mcpBlitOr);
+    registers |= Sign.getRegionRegisters(zone.X + first, zone.X + end - 1);
+  }
+
+  if (registers == 0 || !Sign.beginUpdateRegisters(registers)) {
+    return false;
+  }
+  Updates++;
+  for (; registers != 0; registers &= registers - 1) {
+    RegistersSent++;
+  }
+  return true;
+}
+
+bool mcpZones::isBusy()
+{
+  if (Sign.isBusy()) {
+    return true;
+  }
+  for (byte i = 0; i < NumZones; i++) {
+    if (Zones[i]->Changed || Zones[i]->RenderDue) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void mcpZones::flush()
+{
+  while (isBusy()) {
+    tick();
+    yield();
+  }
+}
+
+unsigned long mcpZones::getUpdates()
+{
+  return Updates;
+}
+
+unsigned long mcpZones::getRegistersSent()
+{
+  return RegistersSent;
+}
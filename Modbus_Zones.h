@@ -0,0 +1,121 @@
+/*
+   Content zones: parts of the sign that change at their own pace.
+
+   A front sign might show a route number on the left and a clock on the
+   right. Each is an mcpZone, an Adafruit_GFX drawing context of its own with
+   (0, 0) at the zone's top left corner and everything outside it clipped.
+   mcpZones copies the zones that changed into the sign's framebuffer and
+   sends only the registers under them:
+
+     mcpSignZone<30> route(0, 0, 16, "route"); // Columns 0-29, all 16 rows
+     mcpSignZone<68> clock(30, 0, 16, "clock"); // Columns 30-97
+     mcpZones zones(mcp);
+
+     void drawClock(mcpZone &zone)
+     {
+       zone.fillScreen(0);
+       zone.setCursor(4, 12);
+       zone.print(...the time...);
+     }
+
+     zones.add(route);
+     zones.add(clock);
+     clock.setRefresh(1000, drawClock); // Redrawn every second
+     route.setCursor(2, 12);
+     route.print("42"); // Drawing marks a zone changed
+
+     for (;;) {
+       zones.tick(); // Never blocks, and runs the sign's tick() too
+     }
+
+   A zone with a render callback is redrawn when its refresh interval is up
+   or invalidate() is called. A zone that was drawn on but came out the same
+   as the sign already shows (a clock redrawn within the same minute) sends
+   nothing. One update goes out at a time: zones that change while one is on
+   the wire go together in the next. Registers hold whole columns, so a zone
+   sends every register its columns touch, and zones sharing a register are
+   sent together.
+
+   While zones are in use, leave the sign's present() alone; UpdateSign() and
+   drawing outside the zones are fine, between zones.tick() calls.
+*/
+#ifndef Modbus_Zones_h
+#define Modbus_Zones_h
+
+#include "Arduino.h"
+#include <Adafruit_GFX.h>
+#include "Modbus_CoProcessor.h"
+
+const byte zonesMaxZones = 8; // Zones one mcpZones can hold
+
+class mcpZone : public Adafruit_GFX
+{
+  public:
+    void drawPixel(int16_t x, int16_t y, uint16_t color);
+    void fillScreen(uint16_t color);
+    // Call render from mcpZones::tick() every intervalMs (0 for only after invalidate())
+    void setRefresh(unsigned long intervalMs, void (*render)(mcpZone &zone));
+    void invalidate(); // Render again at the next tick(), or just send the zone if it has no callback
+    bool isChanged(); // Drawn on since it was last copied to the sign
+    const char *getName();
+    int16_t getX();
+    int16_t getY();
+
+  protected:
+    // Use mcpSignZone, which supplies the columns
+    mcpZone(uint16_t *columns, int16_t x, int16_t y, int16_t w, int16_t h, const char *name);
+
+  private:
+    friend class mcpZones;
+    uint16_t *Columns; // One word per column, bit N is sign row N, as in the framebuffer
+    int16_t X;
+    int16_t Y;
+    uint16_t Mask; // Sign rows the zone covers
+    const char *Name;
+    void (*Render)(mcpZone &zone);
+    unsigned long Interval;
+    unsigned long RenderedAt; // millis() of the last render
+    bool RenderDue;
+    bool Changed;
+};
+
+// A zone Width columns wide, for mcpSignZone (see mcpSignStorage in Modbus_CoProcessor.h)
+template <int Width>
+struct mcpZoneStorage
+{
+  uint16_t columns[Width];
+};
+
+template <int Width>
+class mcpSignZone : private mcpZoneStorage<Width>, public mcpZone
+{
+  public:
+    // Top left corner on the sign, and height (the width is the template's)
+    mcpSignZone(int16_t x, int16_t y, int16_t h = ySize, const char *name = NULL)
+      : mcpZone(this->columns, x, y, Width, h, name) {}
+};
+
+class mcpZones
+{
+  public:
+    mcpZones(mcp &sign);
+    bool add(mcpZone &zone); // False if full
+    mcpZone *find(const char *name); // NULL if no zone has that name
+    // Call from loop(): renders the zones that are due, and once the sign is free copies
+    // the changed ones into its framebuffer and starts sending their registers.
+    // True when it started an update.
+    bool tick();
+    bool isBusy(); // Sending, or a zone is waiting to be sent
+    void flush(); // Blocking: render and send everything changed, and wait until it is out
+    unsigned long getUpdates(); // Updates started
+    unsigned long getRegistersSent();
+
+  private:
+    mcp &Sign;
+    mcpZone *Zones[zonesMaxZones];
+    byte NumZones;
+    unsigned long Updates;
+    unsigned long RegistersSent;
+};
+
+#endif
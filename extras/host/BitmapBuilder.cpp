@@ -0,0 +1,69 @@
+#include "BitmapBuilder.h"
+
+static void addColumn(std::vector<uint8_t> &data, uint16_t column)
+{
+  data.push_back(column & 0xFF);
+  data.push_back(column >> 8);
+}
+
+BitmapBuilder::BitmapBuilder(const uint16_t *columns, int width, int height)
+{
+  uint16_t mask = (uint16_t)(((uint32_t)1 << height) - 1);
+  std::vector<uint16_t> in(width);
+  for (int x = 0; x < width; x++) {
+    in[x] = columns[x] & mask;
+  }
+
+  // A column repeated even once is cheaper as a run (3 bytes) than as it is (4 bytes)
+  int x = 0;
+  while (x < width) {
+    int repeat = 1;
+    while (x + repeat < width && in[x + repeat] == in[x] && repeat < mcpBitmapMaxRepeat) {
+      repeat++;
+    }
+    if (repeat >= 2) {
+      data.push_back(mcpBitmapRun | (repeat - 2));
+      addColumn(data, in[x]);
+      x += repeat;
+      continue;
+    }
+    int literal = 1;
+    while (x + literal < width && literal < mcpBitmapMaxLiteral &&
+           !(x + literal + 1 < width && in[x + literal + 1] == in[x + literal])) {
+      literal++;
+    }
+    data.push_back(literal - 1);
+    for (int i = 0; i < literal; i++) {
+      addColumn(data, in[x + i]);
+    }
+    x += literal;
+  }
+
+  bitmap.width = width;
+  bitmap.height = height;
+  bitmap.size = data.size();
+  bitmap.data = NULL;
+}
+
+const mcpBitmap &BitmapBuilder::build()
+{
+  bitmap.data = data.empty() ? NULL : &data[0];
+  return bitmap;
+}
+
+bool BitmapBuilder::writeHeader(FILE *out, const char *name)
+{
+  fprintf(out, "// Column bitmap made by flipdot_pack, %dx%d dots in %u bytes. See Modbus_Bitmap.h\n",
+          bitmap.width, bitmap.height, bitmap.size);
+  fprintf(out, "#include \"Modbus_Bitmap.h\"\n\n");
+
+  fprintf(out, "static const uint8_t %s_data[] PROGMEM = {", name);
+  for (size_t i = 0; i < data.size(); i++) {
+    fprintf(out, "%s0x%02X,", (i % 12 == 0) ? "\n  " : " ", data[i]);
+  }
+  fprintf(out, "\n};\n\n");
+
+  fprintf(out, "const mcpBitmap %s = {%d, %d, %u, %s_data};\n",
+          name, bitmap.width, bitmap.height, bitmap.size, name);
+  return !ferror(out);
+}
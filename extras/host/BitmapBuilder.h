@@ -0,0 +1,28 @@
+/*
+   Builds column bitmaps (see Modbus_Bitmap.h) on the host.
+
+   The columns are packed like the driver's framebuffer, one word each with
+   the top dot in bit 0. Used by flipdot_pack --bitmap, which writes the
+   result out as a header for the sketch, and by flipdot_sim check, which
+   draws it in memory.
+*/
+#ifndef BitmapBuilder_h
+#define BitmapBuilder_h
+
+#include "Modbus_CoProcessor.h"
+#include <vector>
+
+class BitmapBuilder
+{
+  public:
+    BitmapBuilder(const uint16_t *columns, int width, int height); // Dots below height are dropped
+    const mcpBitmap &build(); // Valid until the builder goes away
+    bool writeHeader(FILE *out, const char *name);
+    size_t size() const { return data.size(); }
+
+  private:
+    std::vector<uint8_t> data;
+    mcpBitmap bitmap;
+};
+
+#endif
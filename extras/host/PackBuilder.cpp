@@ -0,0 +1,87 @@
+#include "PackBuilder.h"
+
+PackBuilder::PackBuilder(mcp &sign)
+  : sign(sign)
+{
+  memset(&pack, 0, sizeof(pack));
+}
+
+void PackBuilder::addFrame(const uint16_t *columns)
+{
+  frames.push_back(std::vector<uint16_t>(columns, columns + sign.width()));
+}
+
+bool PackBuilder::registerDiffers(byte reg, const std::vector<uint16_t> &a, const std::vector<uint16_t> &b) const
+{
+  // Bytestream byte n is the low (even n) or high (odd n) byte of column n / 2
+  const mcpRegister &r = sign.getLayout().registers[reg];
+  for (int n = r.start; n < r.start + r.count; n++) {
+    int shift = (n & 1) ? 8 : 0;
+    if (((a[n / 2] >> shift) & 0xFF) != ((b[n / 2] >> shift) & 0xFF)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+const mcpPack &PackBuilder::build()
+{
+  const mcpLayout &layout = sign.getLayout();
+  records.clear();
+  lines.clear();
+
+  for (size_t f = 0; f < frames.size(); f++) {
+    const std::vector<uint16_t> &previous = frames[(f == 0) ? frames.size() - 1 : f - 1];
+    mcpPackFrame record;
+    record.changed = 0;
+    for (byte reg = 0; reg < layout.numRegisters; reg++) {
+      if (registerDiffers(reg, frames[f], previous)) {
+        record.changed |= (uint16_t)1 << reg;
+      }
+    }
+    // Frame 0 is where playing starts, so it carries every register
+    record.stored = (f == 0) ? (uint16_t)((1UL << layout.numRegisters) - 1) : record.changed;
+    record.firstLine = lineCount();
+
+    sign.drawColumns(0, &frames[f][0], sign.width());
+    sign.ConvertBitmapToBytestream();
+    for (byte reg = 0; reg < layout.numRegisters; reg++) {
+      if (record.stored & ((uint16_t)1 << reg)) {
+        const char *line = sign.EncodeRegister(reg);
+        lines.append(line, mcpPackLineLength);
+      }
+    }
+    records.push_back(record);
+  }
+
+  pack.columns = layout.columns;
+  pack.numRegisters = layout.numRegisters;
+  pack.numFrames = records.size();
+  pack.frames = records.empty() ? NULL : &records[0];
+  pack.lines = lines.c_str();
+  return pack;
+}
+
+bool PackBuilder::writeHeader(FILE *out, const char *name)
+{
+  build();
+  fprintf(out, "// Animation pack made by flipdot_pack, %u frames, %lu register lines. See Modbus_Pack.h\n",
+          pack.numFrames, lineCount());
+  fprintf(out, "#include \"Modbus_Pack.h\"\n\n");
+
+  fprintf(out, "static const mcpPackFrame %s_frames[] PROGMEM = {\n", name);
+  for (size_t f = 0; f < records.size(); f++) {
+    fprintf(out, "  {0x%04X, 0x%04X, %u},\n", records[f].stored, records[f].changed, records[f].firstLine);
+  }
+  fprintf(out, "};\n\n");
+
+  fprintf(out, "static const char %s_lines[] PROGMEM =\n", name);
+  for (unsigned long i = 0; i < lineCount(); i++) {
+    fprintf(out, "  \"%.*s\"%s\n", mcpPackLineLength, lines.c_str() + i * mcpPackLineLength,
+            (i + 1 == lineCount()) ? ";\n" : "");
+  }
+
+  fprintf(out, "const mcpPack %s = {%d, %d, %u, %s_frames, %s_lines};\n",
+          name, pack.columns, pack.numRegisters, pack.numFrames, name, name);
+  return !ferror(out);
+}
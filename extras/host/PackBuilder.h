@@ -0,0 +1,36 @@
+/*
+   Builds animation packs (see Modbus_Pack.h) on the host.
+
+   Frames are added as columns, packed like the driver's framebuffer. The
+   register lines are made by a real driver's EncodeRegister(), so a pack
+   holds exactly what UpdateSign() would have sent for the same images.
+   Used by flipdot_pack, which writes the result out as a header for the
+   sketch, and by flipdot_sim check, which plays it back in memory.
+*/
+#ifndef PackBuilder_h
+#define PackBuilder_h
+
+#include "Modbus_CoProcessor.h"
+#include <string>
+#include <vector>
+
+class PackBuilder
+{
+  public:
+    PackBuilder(mcp &sign); // The sign's layout is used, and its framebuffer drawn over
+    void addFrame(const uint16_t *columns); // sign.width() columns
+    const mcpPack &build(); // Valid until the builder changes or goes away
+    bool writeHeader(FILE *out, const char *name);
+    unsigned long lineCount() const { return lines.size() / mcpPackLineLength; }
+
+  private:
+    bool registerDiffers(byte reg, const std::vector<uint16_t> &a, const std::vector<uint16_t> &b) const;
+
+    mcp &sign;
+    std::vector<std::vector<uint16_t> > frames;
+    std::vector<mcpPackFrame> records;
+    std::string lines;
+    mcpPack pack;
+};
+
+#endif
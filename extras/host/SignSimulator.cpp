@@ -0,0 +1,240 @@
+#include "SignSimulator.h"
+
+// Fixed header at the start of register 0, the image data starts after it
+const int imageHeaderSize = 4;
+
+static int hexValue(char c)
+{
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1; // The driver always sends upper case
+}
+
+SignSimulator::SignSimulator(int columns, int gapStart, int gapColumns, byte signId)
+  : linesReceived(0), registerWrites(0), framesDisplayed(0), badLines(0), badLrc(0),
+    nakEvery(0), badLrcEvery(0), dropEvery(0), repliesSent(0), naksSent(0), badLrcSent(0), repliesDropped(0),
+    nakAddress(-1), registersRejected(0),
+    processMicros(0), linesMissed(0), linesIgnored(0),
+    columns(columns), gapStart(gapStart), gapColumns(gapColumns), signId(signId), loading(false), lineLength(0),
+    replyPort(NULL), replyTurnaround(0), replyCount(0), busyUntil(0)
+{
+  memset(memory, 0, sizeof(memory));
+  memset(displayed, 0, sizeof(displayed));
+}
+
+void SignSimulator::attach(HardwareSerial &port)
+{
+  port.hostSetTxListener(txListener, this);
+}
+
+void SignSimulator::setReplies(HardwareSerial *port, unsigned long turnaroundMicros)
+{
+  replyPort = port;
+  replyTurnaround = turnaroundMicros;
+}
+
+void SignSimulator::txListener(void *context, const uint8_t *data, size_t size)
+{
+  static_cast<SignSimulator *>(context)->feed(data, size);
+}
+
+void SignSimulator::feed(const uint8_t *data, size_t size)
+{
+  for (size_t i = 0; i < size; i++) {
+    char c = (char)data[i];
+    if (c == '\r') {
+      continue;
+    }
+    if (c == '\n') {
+      line[lineLength] = '\0';
+      if (lineLength > 0) {
+        feedLine(line);
+      }
+      lineLength = 0;
+    } else if (lineLength < MAX_LINE - 1) {
+      line[lineLength++] = c;
+    }
+  }
+}
+
+void SignSimulator::feedLine(const char *text)
+{
+  linesReceived++;
+
+  int length = strlen(text);
+  if (text[0] != ':' || length < 3 || (length - 1) % 2 != 0) {
+    badLines++;
+    return;
+  }
+
+  byte bytes[MAX_LINE / 2];
+  int count = (length - 1) / 2;
+  byte sum = 0;
+  for (int i = 0; i < count; i++) {
+    int hi = hexValue(text[1 + 2 * i]);
+    int lo = hexValue(text[2 + 2 * i]);
+    if (hi < 0 || lo < 0) {
+      badLines++;
+      return;
+    }
+    bytes[i] = (byte)(hi * 16 + lo);
+    sum += bytes[i];
+  }
+
+  // The LRC makes all bytes, itself included, sum to zero
+  if (sum != 0) {
+    badLrc++;
+    return;
+  }
+
+  if (count - 1 >= 4 && !forUs(bytes)) {
+    linesIgnored++;
+    return;
+  }
+
+  if (processMicros && replyPort) {
+    // The whole line is written at once, so it starts arriving now
+    if ((long)(micros() - busyUntil) < 0) {
+      linesMissed++;
+      return;
+    }
+    unsigned long byteMicros = 10 * 1000000UL / replyPort->hostBaud();
+    busyUntil = micros() + (length + 2) * byteMicros + processMicros;
+  }
+
+  if (bytes[3] == 0x00 && nakAddress == ((bytes[1] << 8) | bytes[2])) {
+    nakAddress = -1;
+    registersRejected++;
+    reply(bytes, length + 2, true);
+    return;
+  }
+
+  unsigned long badBefore = badLines;
+  handleFrame(bytes, count - 1);
+  if (badLines == badBefore) {
+    reply(bytes, length + 2); // CRLF
+  }
+}
+
+bool SignSimulator::forUs(const byte *bytes) const
+{
+  // Data and end of data records go to the sign that is loading, commands carry the sign ID
+  int address = (bytes[1] << 8) | bytes[2];
+  byte type = bytes[3];
+  if (type == 0x00 || type == 0x01) {
+    return loading;
+  }
+  return address == signId || address == 0x05 || address == 0x7F;
+}
+
+void SignSimulator::reply(const byte *bytes, int lineLength, bool nak)
+{
+  // The answer is the line's address and record type with no data: ":00" AAAA TT LRC.
+  // A NAK sets the exception bit (0x80) in the record type.
+  if (!replyPort) {
+    return;
+  }
+  replyCount++;
+  if (dropEvery && replyCount % dropEvery == 0) {
+    repliesDropped++;
+    return;
+  }
+
+  // A bad LRC wins over a NAK, the driver could not tell it was one
+  byte answer[5] = {0x00, bytes[1], bytes[2], bytes[3], 0};
+  bool corrupt = badLrcEvery && replyCount % badLrcEvery == 0;
+  if (!corrupt && (nak || (nakEvery && replyCount % nakEvery == 0))) {
+    answer[3] |= 0x80;
+    naksSent++;
+  }
+  answer[4] = (byte)-(answer[1] + answer[2] + answer[3]);
+  if (corrupt) {
+    answer[4]++;
+    badLrcSent++;
+  }
+
+  char text[16];
+  snprintf(text, sizeof(text), ":%02X%02X%02X%02X%02X\r\n", answer[0], answer[1], answer[2], answer[3], answer[4]);
+
+  // The line is still going out when its last byte is written, so answer once
+  // it has all arrived, the turnaround has passed, and the first byte is back
+  unsigned long byteMicros = 10 * 1000000UL / replyPort->hostBaud();
+  replyPort->hostInjectAt(micros() + lineLength * byteMicros + replyTurnaround + byteMicros,
+                          (const uint8_t *)text, strlen(text));
+  repliesSent++;
+}
+
+void SignSimulator::handleFrame(const byte *bytes, int count)
+{
+  // bytes: length, address high, address low, type, data..., LRC excluded
+  if (count < 4 || bytes[0] != count - 4) {
+    badLines++;
+    return;
+  }
+  int address = (bytes[1] << 8) | bytes[2];
+  byte type = bytes[3];
+  const byte *data = bytes + 4;
+
+  if (type == 0x00 && bytes[0] == 0x10) {
+    // Image register write
+    if (address + 16 <= MEMORY_SIZE) {
+      memcpy(&memory[address], data, 16);
+      registerWrites++;
+    }
+  } else if (type == 0x01) {
+    loading = false; // End of data
+  } else if (type == 0x03 && bytes[0] == 1 && address == signId && (data[0] == 0xA1 || data[0] == 0xA2)) {
+    loading = true; // Configuration or image load, registers follow
+  } else if (type == 0x03 && bytes[0] == 1 && address == signId && data[0] == 0xA9) {
+    // Display the image
+    memcpy(displayed, memory, sizeof(memory));
+    framesDisplayed++;
+  }
+}
+
+int SignSimulator::memoryOffset(int x) const
+{
+  // Columns after the hole sit gapColumns further along in memory
+  int slot = (x < gapStart) ? x : x + gapColumns;
+  return imageHeaderSize + 2 * slot;
+}
+
+bool SignSimulator::dot(int x, int y) const
+{
+  if (x < 0 || x >= columns || y < 0 || y >= 16) {
+    return false;
+  }
+  int offset = memoryOffset(x) + (y >> 3);
+  return (displayed[offset] >> (y & 7)) & 1;
+}
+
+void SignSimulator::dumpAscii(FILE *out) const
+{
+  for (int y = 0; y < 16; y++) {
+    for (int x = 0; x < columns; x++) {
+      fputc(dot(x, y) ? '#' : '.', out);
+    }
+    fputc('\n', out);
+  }
+}
+
+bool SignSimulator::writePbm(const char *path) const
+{
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    return false;
+  }
+  fprintf(out, "P1\n%d 16\n", columns);
+  for (int y = 0; y < 16; y++) {
+    for (int x = 0; x < columns; x++) {
+      fputs(dot(x, y) ? "1 " : "0 ", out);
+    }
+    fputc('\n', out);
+  }
+  fclose(out);
+  return true;
+}
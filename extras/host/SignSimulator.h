@@ -0,0 +1,92 @@
+/*
+   Host-side simulator of the sign controller.
+
+   It listens to everything the driver writes to the serial port, checks
+   each ":LLAAAATT...CC" line and its LRC, keeps the controller's register
+   memory up to date, and latches the image when the display command
+   (":01000603A94D" for sign ID 6) arrives. The latched image can be read
+   back dot by dot, or dumped as ASCII art or a PBM file.
+
+   It can also answer each good line on a serial port's receive side, for
+   the driver's response pacing, with NAKs, bad LRCs and dropped answers
+   mixed in on request.
+
+   Several simulators can listen to one port, like signs sharing an RS-485
+   line. Each one acts on the command lines for its sign ID (and the ones for
+   every sign, addresses 0x05 and 0x7F), and takes image registers only
+   between a load command for its ID (0xA1 or 0xA2) and the end of data
+   record. Everything else it hears is ignored.
+*/
+#ifndef SignSimulator_h
+#define SignSimulator_h
+
+#include "Arduino.h"
+
+class SignSimulator
+{
+  public:
+    // Geometry of the 98x16 front sign: 14 columns, a 14 column hole, then the rest
+    SignSimulator(int columns = 98, int gapStart = 14, int gapColumns = 14, byte signId = 6);
+
+    void attach(HardwareSerial &port); // Receive everything the driver transmits on this port
+    // Answer each good line on port, turnaroundMicros after it has been received. NULL to stay quiet.
+    void setReplies(HardwareSerial *port, unsigned long turnaroundMicros = 500);
+    void feed(const uint8_t *data, size_t size);
+    void feedLine(const char *line);
+
+    bool dot(int x, int y) const; // Dot state of the displayed image
+    int width() const { return columns; }
+    int height() const { return 16; }
+
+    void dumpAscii(FILE *out) const;
+    bool writePbm(const char *path) const;
+
+    unsigned long linesReceived;
+    unsigned long registerWrites;
+    unsigned long framesDisplayed;
+    unsigned long badLines; // Not ':' followed by an even number of hex digits
+    unsigned long badLrc;
+
+    // Every Nth answer is not sent at all, has a bad LRC, or is a NAK (first match wins). 0 for never.
+    unsigned int nakEvery;
+    unsigned int badLrcEvery;
+    unsigned int dropEvery;
+    unsigned long repliesSent; // Including the NAKs and bad LRCs below
+    unsigned long naksSent;
+    unsigned long badLrcSent;
+    unsigned long repliesDropped;
+    // NAK the next write of the image register at this address and throw its data away,
+    // as a controller that rejected the line would. -1 for none, set back to -1 once done.
+    int nakAddress;
+    unsigned long registersRejected;
+
+    // Time the controller needs after receiving a line for it before it hears the next one
+    // (0 for none). Lines that arrive sooner are missed. Needs setReplies() for the baud rate.
+    unsigned long processMicros;
+    unsigned long linesMissed;
+    unsigned long linesIgnored; // Good lines meant for another sign
+
+  private:
+    enum { MEMORY_SIZE = 256, MAX_LINE = 128 };
+    static void txListener(void *context, const uint8_t *data, size_t size);
+    void handleFrame(const byte *bytes, int count);
+    bool forUs(const byte *bytes) const; // bytes: length, address high, address low, type, ...
+    void reply(const byte *bytes, int lineLength, bool nak = false);
+    int memoryOffset(int x) const; // Offset in register memory of column x's first byte
+
+    int columns;
+    int gapStart;
+    int gapColumns;
+    byte signId;
+    bool loading; // Between a load command for this sign and the end of data record
+    byte memory[MEMORY_SIZE]; // Register memory as written by the driver
+    byte displayed[MEMORY_SIZE]; // Copy of memory taken at the last display command
+    char line[MAX_LINE];
+    int lineLength;
+    HardwareSerial *replyPort;
+    unsigned long replyTurnaround;
+    unsigned long replyCount;
+    unsigned long busyUntil; // micros() when the controller can take the next line
+};
+
+#endif
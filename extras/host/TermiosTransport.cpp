@@ -0,0 +1,114 @@
+/*
+   Transport for a Linux serial device or pty, see TermiosTransport.h
+*/
+#include "TermiosTransport.h"
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <termios.h>
+#include <unistd.h>
+
+TermiosTransport::TermiosTransport()
+{
+  BaudRate = 9600;
+  writeCalls = 0;
+  fd = -1;
+}
+
+TermiosTransport::~TermiosTransport()
+{
+  close();
+}
+
+bool TermiosTransport::open(const char *path)
+{
+  close();
+  fd = ::open(path, O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    perror(path);
+    return false;
+  }
+  struct termios raw;
+  if (tcgetattr(fd, &raw) == 0) {
+    cfmakeraw(&raw);
+    tcsetattr(fd, TCSANOW, &raw);
+  }
+  begin(BaudRate);
+  return true;
+}
+
+void TermiosTransport::close()
+{
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+void TermiosTransport::begin(unsigned long baudRate)
+{
+  mcpTransport::begin(baudRate);
+  struct termios settings;
+  if (fd < 0 || tcgetattr(fd, &settings) != 0) {
+    return;
+  }
+  speed_t speed;
+  switch (baudRate) {
+    case 9600: speed = B9600; break;
+    case 19200: speed = B19200; break;
+    case 38400: speed = B38400; break;
+    case 57600: speed = B57600; break;
+    case 115200: speed = B115200; break;
+    default: return;
+  }
+  cfsetispeed(&settings, speed);
+  cfsetospeed(&settings, speed);
+  tcsetattr(fd, TCSANOW, &settings);
+}
+
+void TermiosTransport::writeLine(const char *line, size_t length)
+{
+  // The line and its CRLF in one system call, however long the line is
+  if (fd < 0) {
+    fprintf(stderr, "TermiosTransport: line written with no device open\n");
+    return;
+  }
+  struct iovec parts[2];
+  parts[0].iov_base = (void *)line;
+  parts[0].iov_len = length;
+  parts[1].iov_base = (void *)"\r\n";
+  parts[1].iov_len = 2;
+  ssize_t written = ::writev(fd, parts, 2);
+  if (written < 0) {
+    perror("writev");
+  } else if (written != (ssize_t)(length + 2)) {
+    fprintf(stderr, "TermiosTransport: only %ld of %lu bytes of a line written\n", (long)written,
+            (unsigned long)(length + 2));
+  }
+  writeCalls++;
+}
+
+int TermiosTransport::available()
+{
+  int count = 0;
+  if (fd < 0 || ioctl(fd, FIONREAD, &count) != 0) {
+    return 0;
+  }
+  return count;
+}
+
+int TermiosTransport::read()
+{
+  uint8_t c;
+  if (available() <= 0 || ::read(fd, &c, 1) != 1) {
+    return -1;
+  }
+  return c;
+}
+
+void TermiosTransport::flush()
+{
+  if (fd >= 0) {
+    tcdrain(fd);
+  }
+}
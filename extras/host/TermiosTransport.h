@@ -0,0 +1,36 @@
+/*
+   Transport for a Linux serial device or pty (see Modbus_Transport.h), for
+   running the driver on a Linux gateway with a USB RS-485 adapter, or
+   against anything that reads a pty. The shim's clock is virtual, so a
+   program driving a real sign calls hostRealTime(true) first; otherwise the
+   driver's line delays take no time and the lines go out back to back.
+
+   Each line and its CRLF go out in a single writev() call, so a line is never
+   split across USB packets, and writeCalls counts them. A write that fails
+   or comes up short is reported on stderr. Only the standard
+   baud rates are set on the device, anything else leaves it as it was.
+*/
+#ifndef TermiosTransport_h
+#define TermiosTransport_h
+
+#include "Modbus_Transport.h"
+
+class TermiosTransport : public mcpTransport
+{
+  public:
+    TermiosTransport();
+    ~TermiosTransport();
+    bool open(const char *path); // Raw mode, perror()s and returns false on failure
+    void close();
+    void begin(unsigned long baudRate);
+    void writeLine(const char *line, size_t length);
+    int available();
+    int read();
+    void flush();
+    unsigned long writeCalls;
+
+  private:
+    int fd;
+};
+
+#endif
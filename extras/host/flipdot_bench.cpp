@@ -0,0 +1,154 @@
+/*
+   Host runner for the UpdateSign() benchmark in Flipdot_Benchmark.h
+
+   flipdot_bench [--frames N] [--save file] [--baseline file] [--strict-cpu]
+
+   Prints per-frame phase timings for each workload. --save writes the same
+   table to a file, --baseline compares against a saved table: line and byte
+   counts must match exactly, the (virtual) flush/EOL waits to within 1% and
+   the whole update to within 50%. Those hold on any machine, so the
+   baseline in bench/ is committed. The CPU phases (render, convert, encode,
+   write) depend on the machine: more than 50% slower than the baseline is
+   reported, and only fails with --strict-cpu, against a baseline recorded
+   on the same machine.
+*/
+#include "Modbus_CoProcessor.h"
+#include "Flipdot_Benchmark.h"
+
+class FilePrint : public Print
+{
+  public:
+    FilePrint(FILE *file) : file(file) {}
+    size_t write(uint8_t c) { return fputc(c, file) == EOF ? 0 : 1; }
+  private:
+    FILE *file;
+};
+
+// Column order of mcpBenchmarkPrint()
+enum { RENDER, CONVERT, ENCODE, WRITE, FLUSH, EOL, UPDATE, LINES, BYTES, NUM_COLUMNS };
+static const char *const columnNames[NUM_COLUMNS] = {
+  "render", "convert", "encode", "write", "flush", "eol", "update", "lines", "bytes",
+};
+
+static void perFrame(const mcpBenchResult &r, unsigned long *values)
+{
+  const mcpProfile &p = r.profile;
+  unsigned long n = r.frames ? r.frames : 1;
+  const unsigned long totals[NUM_COLUMNS] = {
+    r.renderMicros, p.convertMicros, p.encodeMicros, p.writeMicros,
+    p.flushMicros, p.eolMicros, p.updateMicros, p.lines, p.bytes,
+  };
+  for (int i = 0; i < NUM_COLUMNS; i++) {
+    values[i] = totals[i] / n;
+  }
+}
+
+static int compareBaseline(const char *path, const mcpBenchResult *results, bool strictCpu)
+{
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    perror(path);
+    return 2;
+  }
+
+  int failures = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    char name[32];
+    unsigned int frames;
+    unsigned long base[NUM_COLUMNS];
+    if (line[0] == '#' ||
+        sscanf(line, "%31s %u %lu %lu %lu %lu %lu %lu %lu %lu %lu", name, &frames,
+               &base[0], &base[1], &base[2], &base[3], &base[4], &base[5], &base[6], &base[7], &base[8]) != 11) {
+      continue;
+    }
+
+    for (int w = 0; w < MCP_BENCH_WORKLOADS; w++) {
+      if (strcmp(name, results[w].name) != 0) {
+        continue;
+      }
+      unsigned long now[NUM_COLUMNS];
+      perFrame(results[w], now);
+      for (int i = 0; i < NUM_COLUMNS; i++) {
+        bool bad;
+        bool cpu = (i == RENDER || i == CONVERT || i == ENCODE || i == WRITE);
+        if (i == LINES || i == BYTES) {
+          bad = now[i] != base[i];
+        } else if (i == FLUSH || i == EOL) {
+          // Virtual time, only a few real microseconds of noise on top
+          unsigned long diff = (now[i] > base[i]) ? now[i] - base[i] : base[i] - now[i];
+          bad = diff > base[i] / 100 + 2;
+        } else {
+          bad = now[i] > base[i] + base[i] / 2 + 2;
+        }
+        if (bad && cpu && !strictCpu) {
+          printf("slower %s %s: %lu, baseline %lu (CPU time, not failing)\n", name, columnNames[i], now[i],
+                 base[i]);
+        } else if (bad) {
+          printf("REGRESSION %s %s: %lu, baseline %lu\n", name, columnNames[i], now[i], base[i]);
+          failures++;
+        }
+      }
+    }
+  }
+  fclose(file);
+
+  if (!failures) {
+    printf("no regressions against %s\n", path);
+  }
+  return failures ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned int frames = 20;
+  const char *savePath = NULL;
+  const char *baselinePath = NULL;
+  bool strictCpu = false;
+  for (int i = 1; i < argc; i += 2) {
+    if (!strcmp(argv[i], "--strict-cpu")) {
+      strictCpu = true;
+      i--;
+    } else if (i + 1 >= argc) {
+      fprintf(stderr, "usage: %s [--frames N] [--save file] [--baseline file] [--strict-cpu]\n", argv[0]);
+      return 2;
+    } else if (!strcmp(argv[i], "--frames")) {
+      frames = atoi(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--save")) {
+      savePath = argv[i + 1];
+    } else if (!strcmp(argv[i], "--baseline")) {
+      baselinePath = argv[i + 1];
+    } else {
+      fprintf(stderr, "usage: %s [--frames N] [--save file] [--baseline file] [--strict-cpu]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  mcpFrontSign sign(19200);
+  mcpBenchResult results[MCP_BENCH_WORKLOADS];
+  for (byte w = 0; w < MCP_BENCH_WORKLOADS; w++) {
+    mcpBenchmarkRun(sign, w, frames, results[w]);
+  }
+
+  FilePrint out(stdout);
+  mcpBenchmarkPrintHeader(out);
+  for (byte w = 0; w < MCP_BENCH_WORKLOADS; w++) {
+    mcpBenchmarkPrint(out, results[w]);
+  }
+
+  if (savePath) {
+    FILE *file = fopen(savePath, "w");
+    if (!file) {
+      perror(savePath);
+      return 2;
+    }
+    FilePrint saved(file);
+    mcpBenchmarkPrintHeader(saved);
+    for (byte w = 0; w < MCP_BENCH_WORKLOADS; w++) {
+      mcpBenchmarkPrint(saved, results[w]);
+    }
+    fclose(file);
+  }
+
+  return baselinePath ? compareBaseline(baselinePath, results, strictCpu) : 0;
+}
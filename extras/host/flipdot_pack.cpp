@@ -0,0 +1,201 @@
+/*
+   Animation pack compiler, see Modbus_Pack.h
+
+   flipdot_pack [--name name] [--layout front|side|rear] out.h frame.pbm...
+     Reads the frames (PBM, plain or raw, as wide as the sign and 16 tall),
+     encodes them with the driver and writes a header holding the pack as
+     PROGMEM data. The layout is the sign the pack will be played on: the
+     98x16 front sign (the default), the 112x16 side or the 28x16 rear sign.
+
+   flipdot_pack --bitmap [--name name] out.h image.pbm
+     Reads an image of any width, up to 16 dots tall, and writes a header
+     holding it as a column bitmap (see Modbus_Bitmap.h) instead.
+*/
+#include "Modbus_CoProcessor.h"
+#include "PackBuilder.h"
+#include "BitmapBuilder.h"
+
+// Next number in a PBM header, skipping white space and comments
+static bool readNumber(FILE *in, int &value)
+{
+  int c = fgetc(in);
+  while (c == '#' || c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+    if (c == '#') {
+      while (c != '\n' && c != EOF) {
+        c = fgetc(in);
+      }
+    }
+    c = fgetc(in);
+  }
+  if (c < '0' || c > '9') {
+    return false;
+  }
+  value = 0;
+  while (c >= '0' && c <= '9') {
+    value = value * 10 + (c - '0');
+    c = fgetc(in);
+  }
+  return true; // The one white space character after the number has been read too
+}
+
+// Read a PBM up to 16 dots tall into columns, one word per column with dot y in bit y
+static bool readPbm(const char *path, int &width, int &height, std::vector<uint16_t> &columns)
+{
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    perror(path);
+    return false;
+  }
+  int w = 0;
+  int h = 0;
+  char magic[2] = {0, 0};
+  bool ok = fread(magic, 1, 2, in) == 2 && magic[0] == 'P' && (magic[1] == '1' || magic[1] == '4') &&
+            readNumber(in, w) && readNumber(in, h);
+  if (!ok || w < 1 || h < 1 || h > 16) {
+    fprintf(stderr, "%s: not a PBM up to 16 dots tall\n", path);
+    fclose(in);
+    return false;
+  }
+
+  width = w;
+  height = h;
+  columns.assign(width, 0);
+  for (int y = 0; y < h && ok; y++) {
+    int bits = 0;
+    for (int x = 0; x < w && ok; x++) {
+      int dot;
+      if (magic[1] == '1') {
+        int c = fgetc(in);
+        while (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+          c = fgetc(in);
+        }
+        ok = (c == '0' || c == '1');
+        dot = (c == '1');
+      } else {
+        if ((x & 7) == 0) {
+          bits = fgetc(in);
+          ok = (bits != EOF);
+        }
+        dot = (bits >> (7 - (x & 7))) & 1; // Rows are padded to whole bytes, leftmost dot first
+      }
+      if (dot) {
+        columns[x] |= (uint16_t)1 << y;
+      }
+    }
+  }
+  fclose(in);
+  if (!ok) {
+    fprintf(stderr, "%s: image data is short or broken\n", path);
+  }
+  return ok;
+}
+
+template <typename Sign>
+static int compile(const char *name, const char *outPath, char **framePaths, int numFrames)
+{
+  Sign sign(19200);
+  PackBuilder builder(sign);
+  for (int i = 0; i < numFrames; i++) {
+    std::vector<uint16_t> columns;
+    int width;
+    int height;
+    if (!readPbm(framePaths[i], width, height, columns)) {
+      return 1;
+    }
+    if (width != sign.width() || height != 16) {
+      fprintf(stderr, "%s: not %dx16\n", framePaths[i], sign.width());
+      return 1;
+    }
+    builder.addFrame(&columns[0]);
+  }
+
+  FILE *out = fopen(outPath, "w");
+  if (!out) {
+    perror(outPath);
+    return 1;
+  }
+  bool ok = builder.writeHeader(out, name);
+  ok = (fclose(out) == 0) && ok;
+  if (!ok) {
+    perror(outPath);
+    return 1;
+  }
+  printf("%s: %d frames, %lu register lines, %lu bytes of flash\n", outPath, numFrames, builder.lineCount(),
+         builder.lineCount() * mcpPackLineLength + 1 + numFrames * sizeof(mcpPackFrame));
+  return 0;
+}
+
+static int compileBitmap(const char *name, const char *outPath, const char *imagePath)
+{
+  std::vector<uint16_t> columns;
+  int width;
+  int height;
+  if (!readPbm(imagePath, width, height, columns)) {
+    return 1;
+  }
+  BitmapBuilder builder(&columns[0], width, height);
+
+  FILE *out = fopen(outPath, "w");
+  if (!out) {
+    perror(outPath);
+    return 1;
+  }
+  bool ok = builder.writeHeader(out, name);
+  ok = (fclose(out) == 0) && ok;
+  if (!ok) {
+    perror(outPath);
+    return 1;
+  }
+  printf("%s: %dx%d dots, %lu bytes of flash (%d as rows of dots)\n", outPath, width, height,
+         (unsigned long)builder.size(), (width + 7) / 8 * height);
+  return 0;
+}
+
+static int usage(const char *self)
+{
+  fprintf(stderr, "usage: %s [--name name] [--layout front|side|rear] out.h frame.pbm...\n"
+                  "       %s --bitmap [--name name] out.h image.pbm\n", self, self);
+  return 2;
+}
+
+int main(int argc, char **argv)
+{
+  const char *name = "pack";
+  const char *layout = "front";
+  bool bitmap = false;
+  int arg = 1;
+  while (arg + 1 < argc && argv[arg][0] == '-') {
+    if (!strcmp(argv[arg], "--bitmap")) {
+      bitmap = true;
+      arg++;
+      continue;
+    }
+    if (!strcmp(argv[arg], "--name")) {
+      name = argv[arg + 1];
+    } else if (!strcmp(argv[arg], "--layout")) {
+      layout = argv[arg + 1];
+    } else {
+      return usage(argv[0]);
+    }
+    arg += 2;
+  }
+  if (argc - arg < 2 || (bitmap && argc - arg != 2)) {
+    return usage(argv[0]);
+  }
+  if (bitmap) {
+    return compileBitmap(name, argv[arg], argv[arg + 1]);
+  }
+
+  // The sign ID makes no difference to the register lines
+  const char *outPath = argv[arg];
+  if (!strcmp(layout, "front")) {
+    return compile<mcpFrontSign>(name, outPath, argv + arg + 1, argc - arg - 1);
+  }
+  if (!strcmp(layout, "side")) {
+    return compile<mcpSign<112, 7> >(name, outPath, argv + arg + 1, argc - arg - 1);
+  }
+  if (!strcmp(layout, "rear")) {
+    return compile<mcpSign<28, 8> >(name, outPath, argv + arg + 1, argc - arg - 1);
+  }
+  return usage(argv[0]);
+}
@@ -0,0 +1,1620 @@
+/*
+   Host front end for the sign simulator.
+
+   flipdot_sim decode [--pbm file] < transcript
+     Decodes a capture of the serial line and prints the last displayed image.
+
+   flipdot_sim serve
+     Opens a pty, prints its name, and runs the frame ingest server
+     (Modbus_Ingest.h) on it against the simulator, printing each image
+     the sign displays. Point the controller at the pty instead of the
+     sketch's USB serial port.
+
+   flipdot_sim check [--transcript file] [--out dir]
+     Runs a set of drawing workloads through the real driver against the
+     simulator, and checks that every image the sign displays matches the
+     framebuffer dot for dot. Optionally saves everything sent on the wire,
+     so it can be compared byte for byte with an earlier run. Images for
+     the tools to compile are written to dir (by default the current one).
+*/
+#include "Modbus_CoProcessor.h"
+#include "Modbus_Bus.h"
+#include "Modbus_Scroller.h"
+#include "SignSimulator.h"
+#include "Modbus_Ingest.h"
+#include "Modbus_Pacer.h"
+#include "Modbus_Zones.h"
+#include "PackBuilder.h"
+#include "BitmapBuilder.h"
+#include "TermiosTransport.h"
+#include <Fonts/FreeMonoBold9pt7b.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/select.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+static FILE *transcript = NULL;
+static SignSimulator *simulator = NULL;
+static const char *outDir = "."; // Where check leaves images for the tools, see --out
+
+static void recordTx(void *context, const uint8_t *data, size_t size)
+{
+  (void)context;
+  if (transcript) {
+    fwrite(data, 1, size, transcript);
+  }
+  simulator->feed(data, size);
+}
+
+static int mismatches = 0;
+
+// Dots where the simulated sign and the driver's framebuffer differ
+static int dotsWrong(mcp &sign)
+{
+  int wrong = 0;
+  for (int x = 0; x < sign.width(); x++) {
+    for (int y = 0; y < sign.height(); y++) {
+      if (sign.getPixel(x, y) != simulator->dot(x, y)) {
+        wrong++;
+      }
+    }
+  }
+  return wrong;
+}
+
+// Compare the simulated sign with the driver's framebuffer
+static void verify(mcp &sign, const char *name)
+{
+  int wrong = dotsWrong(sign);
+  if (wrong) {
+    printf("FAIL %-12s %d dots differ\n", name, wrong);
+    simulator->dumpAscii(stdout);
+    mismatches++;
+  } else {
+    printf("ok   %s\n", name);
+  }
+}
+
+// Round trip a few images through another sign size, with a simulator of that size
+template <typename Sign>
+static bool checkLayout(const char *name, SignSimulator &sim)
+{
+  simulator = &sim;
+  Sign sign(19200);
+  sign.InitSign();
+
+  sign.dotAllOn();
+  sign.UpdateSign();
+  verify(sign, name);
+
+  for (int i = 0; i < sign.width(); i += 9) {
+    sign.dotAllOff();
+    sign.fillCircle(i, 7, 5, 1);
+    sign.drawFastVLine(sign.width() - 1 - i, 0, sign.height(), 1);
+    sign.UpdateSign();
+    verify(sign, name);
+  }
+  return sim.badLines == 0 && sim.badLrc == 0;
+}
+
+// The same updates with the fixed EOL delay and with response pacing, against a
+// simulator that answers each line, with some NAKs, bad LRCs and silences mixed in
+static unsigned long pacedUpdates(mcp &sign)
+{
+  unsigned long start = millis();
+  sign.dotAllOn();
+  sign.UpdateSign(true);
+  verify(sign, "paced");
+  for (int i = 0; i < sign.width(); i += 13) {
+    sign.dotAllOff();
+    sign.fillCircle(i, 7, 5, 1);
+    sign.UpdateSign(true);
+    verify(sign, "paced");
+  }
+  sign.invertAll();
+  sign.beginUpdate(true);
+  while (sign.isBusy()) {
+    sign.tick();
+    hostAdvanceMicros(100);
+  }
+  verify(sign, "paced-async");
+  return millis() - start;
+}
+
+static bool checkPacing()
+{
+  SignSimulator sim;
+  sim.nakEvery = 17;
+  sim.badLrcEvery = 23;
+  sim.dropEvery = 29;
+  simulator = &sim;
+  sim.setReplies(&Serial3);
+
+  mcpFrontSign sign(19200);
+  sign.InitSign();
+  unsigned long fixedMs = pacedUpdates(sign);
+  delay(2 * eolDelay); // Let the last answer arrive, answers are counted without pacing too
+  sign.ReadReplies();
+  sign.resetLinkStats();
+  sim.repliesSent = sim.naksSent = sim.badLrcSent = sim.repliesDropped = 0;
+
+  sign.setResponsePacing(true);
+  unsigned long pacedMs = pacedUpdates(sign);
+  sim.setReplies(NULL);
+
+  mcpLinkStats link = sign.getLinkStats();
+  printf("fixed delay %lu ms, paced %lu ms; %lu acks, %lu NAKs, %lu bad LRCs, %lu timeouts\n",
+         fixedMs, pacedMs, link.acks, link.naks, link.badLrc, link.timeouts);
+  bool ok = link.naks == sim.naksSent && link.badLrc == sim.badLrcSent &&
+            link.timeouts == sim.repliesDropped &&
+            link.acks == sim.repliesSent - sim.naksSent - sim.badLrcSent &&
+            pacedMs < fixedMs && sim.badLines == 0 && sim.badLrc == 0;
+  if (!ok) {
+    printf("FAIL pacing, the simulator sent %lu answers (%lu NAKs, %lu bad LRCs) and dropped %lu\n",
+           sim.repliesSent, sim.naksSent, sim.badLrcSent, sim.repliesDropped);
+  }
+  return ok;
+}
+
+// The sign NAKs one register and drops it, blocking and then paced asynchronous. The
+// next update must send that register again, and only that one.
+static bool checkRejectedRegister()
+{
+  SignSimulator sim;
+  simulator = &sim;
+  sim.setReplies(&Serial3);
+  mcpFrontSign sign(19200);
+  sign.InitSign();
+  sign.UpdateSign(); // Blank, so the sign and the driver agree on every register
+  sign.setTextColor(1);
+  sign.setTextSize(2);
+  sign.setCursor(1, 1);
+  sign.print("NAK 42");
+
+  sim.nakAddress = 0x30; // Register 3
+  sign.UpdateSign();
+  bool ok = sim.registersRejected == 1 && sign.getLinkStats().naks == 1 && dotsWrong(sign) > 0;
+  unsigned long writes = sim.registerWrites;
+  sign.UpdateSign();
+  ok = ok && sim.registerWrites - writes == 1 && dotsWrong(sign) == 0;
+  verify(sign, "nak-resend");
+
+  sign.setResponsePacing(true);
+  sign.dotAllOff();
+  sign.setCursor(1, 1);
+  sign.print("ACK 7");
+  sim.nakAddress = 0x10; // Register 1
+  sign.beginUpdate();
+  while (sign.isBusy()) {
+    sign.tick();
+    hostAdvanceMicros(100);
+  }
+  ok = ok && sim.registersRejected == 2 && sign.getLinkStats().naks == 2 && dotsWrong(sign) > 0;
+  writes = sim.registerWrites;
+  sign.beginUpdate();
+  while (sign.isBusy()) {
+    sign.tick();
+    hostAdvanceMicros(100);
+  }
+  ok = ok && sim.registerWrites - writes == 1;
+  verify(sign, "nak-resend-async");
+
+  // Nothing left to send
+  writes = sim.registerWrites;
+  sign.UpdateSign();
+  ok = ok && sim.registerWrites == writes;
+  sim.setReplies(NULL);
+
+  printf("rejected registers: %lu NAKed, each sent again by the next update\n", sim.registersRejected);
+  if (!ok || sim.badLines || sim.badLrc) {
+    printf("FAIL rejected register\n");
+    return false;
+  }
+  return true;
+}
+
+// Calibrate against a simulator that needs some time after each line, then check the
+// saved delay loads into a fresh driver and works. A silent sign cannot be calibrated.
+static bool checkCalibration()
+{
+  SignSimulator sim;
+  sim.processMicros = 6500; // So 7 ms works and 6 ms does not
+  simulator = &sim;
+
+  mcpFrontSign silent(19200);
+  bool silentOk = silent.calibrateLineDelay() < 0 && silent.getLineDelay() == (unsigned int)eolDelay;
+
+  sim.setReplies(&Serial3);
+  mcpFrontSign sign(19200);
+  sign.InitSign();
+  int lineDelay = sign.calibrateLineDelay();
+  bool saved = sign.saveCalibration();
+  unsigned long probeMissed = sim.linesMissed; // Expected, calibration goes until the sign misses lines
+
+  mcpFrontSign fresh(19200);
+  bool loaded = fresh.loadCalibration();
+  fresh.dotAllOn();
+  fresh.UpdateSign();
+  verify(fresh, "calibrated");
+  fresh.drawFastHLine(0, 7, fresh.width(), 0);
+  fresh.UpdateSign();
+  verify(fresh, "calibrated");
+
+  printf("calibrated line delay %d ms, %lu lines missed while probing\n", lineDelay, probeMissed);
+#if MCP_EEPROM
+  bool keptOk = saved && loaded && fresh.getLineDelay() == (unsigned int)lineDelay;
+#else
+  bool keptOk = !saved && !loaded && fresh.getLineDelay() == (unsigned int)eolDelay; // Nowhere to keep it
+#endif
+  bool ok = silentOk && lineDelay == 7 + calibrationMargin && keptOk && sim.linesMissed == probeMissed;
+  if (!ok) {
+    printf("FAIL calibration, silent sign %s, saved %d, loaded %d with %u ms, %lu lines missed since\n",
+           silentOk ? "ok" : "not rejected", saved, loaded, fresh.getLineDelay(), sim.linesMissed - probeMissed);
+  }
+  sim.setReplies(NULL);
+  return ok;
+}
+
+// Scroll text from a pre-rendered strip, and check every step against drawing
+// the text straight onto the sign at the same place (twice, where it wraps round)
+static bool checkScroller()
+{
+  SignSimulator sim;
+  simulator = &sim;
+  mcpFrontSign sign(19200);
+  mcpFrontSign reference(19200);
+  mcpScrollStrip<200> strip;
+  const char *text = "Downtown via Main St";
+  const int gap = 17;
+
+  strip.setTextSize(1);
+  strip.setCursor(0, 4);
+  strip.print(text);
+  strip.setGap(gap);
+  int lap = strip.getLength();
+
+  reference.setTextWrap(false);
+  reference.setTextColor(1);
+  int wrong = 0;
+  sign.InitSign();
+  for (int offset = -5; offset < 2 * lap; offset += 3) {
+    strip.drawTo(sign, offset);
+    int from = ((offset % lap) + lap) % lap;
+    reference.dotAllOff();
+    reference.setCursor(-from, 4);
+    reference.print(text);
+    reference.setCursor(lap - from, 4);
+    reference.print(text);
+    for (int x = 0; x < sign.width(); x++) {
+      for (int y = 0; y < sign.height(); y++) {
+        wrong += sign.getPixel(x, y) != reference.getPixel(x, y);
+      }
+    }
+    if (offset % 15 == 0) {
+      sign.UpdateSign();
+      verify(sign, "scroll");
+    }
+  }
+
+  printf("scrolled %d columns of text over %d steps\n", lap, (2 * lap + 5 + 2) / 3);
+  if (wrong || lap != 6 * (int)strlen(text) + gap || sim.badLines || sim.badLrc) {
+    printf("FAIL scroll, %d dots differ from drawing the text, lap of %d columns\n", wrong, lap);
+    return false;
+  }
+  return true;
+}
+
+// Draw the same text on the sign, which draws glyphs a column at a time, and on a
+// strip, which draws them through Adafruit_GFX a dot at a time, and compare
+static int compareText(mcp &sign, mcpStrip &strip, const char *name, const GFXfont *font, uint8_t size,
+                       uint16_t color, uint16_t bg, int16_t x, int16_t y, bool wrap)
+{
+  randomSeed(7);
+  for (int px = 0; px < sign.width(); px++) {
+    for (int py = 0; py < sign.height(); py++) {
+      uint16_t dot = random(2);
+      sign.drawPixel(px, py, dot);
+      strip.drawPixel(px, py, dot);
+    }
+  }
+
+  Adafruit_GFX *targets[2] = {&sign, &strip};
+  for (int i = 0; i < 2; i++) {
+    targets[i]->setFont(font);
+    targets[i]->setTextSize(size);
+    targets[i]->setTextColor(color, bg);
+    targets[i]->setTextWrap(wrap);
+    targets[i]->setCursor(x, y);
+    targets[i]->print("Hi 42!\n{~}");
+    targets[i]->print(1234567UL);
+    targets[i]->write(0xB1);
+    targets[i]->setFont();
+  }
+
+  int wrong = 0;
+  for (int px = 0; px < sign.width(); px++) {
+    for (int py = 0; py < sign.height(); py++) {
+      wrong += sign.getPixel(px, py) != (bool)((strip.getColumns()[px] >> py) & 1);
+    }
+  }
+  if (wrong || sign.getCursorX() != strip.getCursorX() || sign.getCursorY() != strip.getCursorY()) {
+    printf("FAIL %-12s %d dots differ, cursor %d,%d instead of %d,%d\n", name, wrong,
+           sign.getCursorX(), sign.getCursorY(), strip.getCursorX(), strip.getCursorY());
+    return 1;
+  }
+  return 0;
+}
+
+static bool checkText()
+{
+  mcpFrontSign sign(19200);
+  mcpScrollStrip<98> strip; // As wide as the sign, so text wraps at the same place
+  int failed = 0;
+  failed += compareText(sign, strip, "text-1x", NULL, 1, 1, 1, 1, 1, true);
+  failed += compareText(sign, strip, "text-2x", NULL, 2, 1, 1, -3, -5, true);
+  failed += compareText(sign, strip, "text-3x-bg", NULL, 3, 1, 0, 2, 0, false);
+  failed += compareText(sign, strip, "text-off", NULL, 2, 0, 0, 5, 3, false);
+  failed += compareText(sign, strip, "text-off-bg", NULL, 1, 0, 1, 0, 9, true);
+  failed += compareText(sign, strip, "text-5x", NULL, 5, 1, 1, 0, -20, false);
+  failed += compareText(sign, strip, "font-1x", &FreeMonoBold9pt7b, 1, 1, 1, 0, 13, true);
+  failed += compareText(sign, strip, "font-2x", &FreeMonoBold9pt7b, 2, 1, 1, -4, 20, false);
+  failed += compareText(sign, strip, "font-off", &FreeMonoBold9pt7b, 1, 0, 0, 3, 11, true);
+  failed += compareText(sign, strip, "font-3x", &FreeMonoBold9pt7b, 3, 1, 1, 0, 30, false);
+  printf("%s text drawn by column matches Adafruit_GFX\n", failed ? "FAIL" : "ok  ");
+  return failed == 0;
+}
+
+// Show the framebuffer the sign should be showing, so verify() can check it
+static void expect(mcp &sign, const std::vector<uint16_t> &columns)
+{
+  sign.drawColumns(0, &columns[0], sign.width());
+}
+
+// Build a pack from a moving circle (with one frame repeated) and play it twice
+// round, checking every frame and that only changed registers go out. The
+// displayed frames are saved as PBMs for 'make check' to run through flipdot_pack.
+static bool checkPack()
+{
+  mcpFrontSign encoder(19200);
+  PackBuilder builder(encoder);
+  std::vector<std::vector<uint16_t> > frames;
+  for (int frame = 0; frame < 8; frame++) {
+    encoder.dotAllOff();
+    encoder.fillCircle(10 + frame * 11, 7, 6, 1);
+    if (frame == 3) {
+      encoder.fillCircle(10 + (frame - 1) * 11, 7, 6, 1); // The same registers as frame 2, plus some
+    }
+    std::vector<uint16_t> columns(encoder.width());
+    for (int x = 0; x < encoder.width(); x++) {
+      for (int y = 0; y < encoder.height(); y++) {
+        columns[x] |= (uint16_t)encoder.getPixel(x, y) << y;
+      }
+    }
+    frames.push_back(columns);
+    if (frame == 5) {
+      frames.push_back(columns); // Nothing changes
+    }
+  }
+  for (size_t f = 0; f < frames.size(); f++) {
+    builder.addFrame(&frames[f][0]);
+  }
+  const mcpPack &pack = builder.build();
+
+  SignSimulator sim;
+  simulator = &sim;
+  mcpFrontSign sign(19200);
+  sign.InitSign();
+  bool ok = !sign.playFrame(pack, 1); // Has to start at frame 0
+  mcpSign<112, 7> side(19200);
+  ok = ok && !side.playFrame(pack, 0); // Wrong size
+
+  unsigned long writesBefore = sim.registerWrites;
+  for (int lap = 0; lap < 2; lap++) {
+    for (uint16_t f = 0; f < pack.numFrames; f++) {
+      ok = ((lap == 0 && f == 5) ? sign.beginFrame(pack, f) : sign.playFrame(pack, f)) && ok;
+      while (sign.isBusy()) {
+        sign.tick();
+        hostAdvanceMicros(100);
+      }
+      expect(sign, frames[f]);
+      verify(sign, "pack");
+      if (lap == 0 && f < 2) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/pack-%d.pbm", outDir, f);
+        if (!sim.writePbm(path)) {
+          perror(path);
+          ok = false;
+        }
+      }
+    }
+  }
+  unsigned long writes = sim.registerWrites - writesBefore;
+  unsigned long expected = 0;
+  for (int lap = 0; lap < 2; lap++) {
+    for (uint16_t f = 0; f < pack.numFrames; f++) {
+      uint16_t sent = (lap == 0 && f == 0) ? pack.frames[f].stored : pack.frames[f].changed;
+      for (; sent; sent &= sent - 1) {
+        expected++;
+      }
+    }
+  }
+
+  // Back to drawing, everything is sent again
+  sign.dotAllOn();
+  sign.UpdateSign();
+  verify(sign, "after-pack");
+
+  printf("pack of %u frames, %lu stored lines, %lu register writes to play it twice\n",
+         pack.numFrames, builder.lineCount(), writes);
+  if (!ok || writes != expected || sim.badLines || sim.badLrc) {
+    printf("FAIL pack, %lu register writes instead of %lu\n", writes, expected);
+    return false;
+  }
+  return true;
+}
+
+// A clock that ticks between two times: after each has been sent once,
+// every register line comes from the cache
+static bool checkLineCache()
+{
+  SignSimulator sim;
+  simulator = &sim;
+  mcpFrontSign sign(19200);
+  sign.InitSign();
+  sign.setTextSize(2);
+  sign.setTextColor(1);
+  for (int i = 0; i < 6; i++) {
+    sign.dotAllOff();
+    sign.setCursor(1, 1);
+    sign.print((i & 1) ? "12:01" : "12:00");
+    sign.UpdateSign(true);
+    verify(sign, "line-cache");
+  }
+  mcpLineCacheStats stats = sign.getLineCacheStats();
+  unsigned long registers = sign.getLayout().numRegisters;
+  printf("line cache %lu hits, %lu misses\n", stats.hits, stats.misses);
+#if MCP_LINE_CACHE >= 2
+  bool ok = stats.misses <= 2 * registers && stats.hits >= 4 * registers;
+#else
+  bool ok = true;
+#endif
+  if (!ok || stats.hits + stats.misses != 6 * registers || sim.badLines || sim.badLrc) {
+    printf("FAIL line cache\n");
+    return false;
+  }
+  return true;
+}
+
+// Send a region only, with a change outside it held back until the next UpdateSign()
+static bool checkRegion()
+{
+  SignSimulator sim;
+  simulator = &sim;
+  mcpFrontSign sign(19200);
+  sign.InitSign();
+  sign.dotAllOff();
+  sign.UpdateSign();
+
+  sign.fillRect(40, 3, 6, 8, 1);
+  sign.drawPixel(90, 4, 1); // Outside the region, not sent yet
+  unsigned long before = sim.registerWrites;
+  sign.updateRegion(40, 3, 45, 10);
+  unsigned long regionWrites = sim.registerWrites - before;
+  bool heldBack = !sim.dot(90, 4) && sim.dot(42, 5);
+  sign.drawPixel(90, 4, 0);
+  verify(sign, "region");
+
+  sign.drawPixel(90, 4, 1);
+  before = sim.registerWrites;
+  sign.UpdateSign();
+  unsigned long laterWrites = sim.registerWrites - before;
+  verify(sign, "region-later");
+
+  sign.drawPixel(60, 0, 1);
+  sign.beginUpdateRegion(60, 0, 60, 0);
+  while (sign.isBusy()) {
+    sign.tick();
+    hostAdvanceMicros(100);
+  }
+  verify(sign, "region-async");
+
+  // On the front sign columns 40-45 are all in R7 and column 90 in R13. R2 is the
+  // empty register standing in for the gap, so no region includes it.
+  bool ok = sign.getRegionRegisters(40, 45) == (1 << 7) && sign.getRegionRegisters(-5, 200) == 0x7FFB &&
+            sign.getRegionRegisters(90, 90) == (1 << 13) && heldBack && regionWrites == 1 && laterWrites == 1;
+  printf("region of 6 columns sent as %lu register, the change outside it as %lu later\n", regionWrites, laterWrites);
+  if (!ok || sim.badLines || sim.badLrc) {
+    printf("FAIL region, registers 0x%04X\n", sign.getRegionRegisters(40, 45));
+    return false;
+  }
+  return true;
+}
+
+// Open a pty. The sketch's end is master, the controller's
+// end (the one a real controller would know as /dev/ttyACM0) is named in slave.
+static int openPty(std::string &slave)
+{
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) || unlockpt(master)) {
+    perror("posix_openpt");
+    return -1;
+  }
+  slave = ptsname(master);
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+  return master;
+}
+
+// Hand whatever the controller has written to the pty to the sketch's port.
+// False once the controller has closed its end.
+static bool pumpIngestPty(int master, HardwareSerial &port)
+{
+  uint8_t buffer[256];
+  ssize_t n;
+  while ((n = read(master, buffer, sizeof(buffer))) > 0) {
+    port.hostInject(buffer, n);
+  }
+  return !(n < 0 && errno == EIO);
+}
+
+// A packet for the ingest server: columns x to x + count - 1, optionally with a broken CRC
+static void ingestPacket(std::vector<uint8_t> &out, int x, const uint16_t *columns, int count, bool badCrc = false)
+{
+  uint16_t crc = 0xFFFF;
+  out.push_back(ingestSync0);
+  out.push_back(ingestSync1);
+  out.push_back(x);
+  out.push_back(count);
+  crc = mcpIngestCrc(mcpIngestCrc(crc, x), count);
+  for (int i = 0; i < count; i++) {
+    out.push_back(columns[i] & 0xFF);
+    out.push_back(columns[i] >> 8);
+    crc = mcpIngestCrc(mcpIngestCrc(crc, columns[i] & 0xFF), columns[i] >> 8);
+  }
+  if (badCrc) {
+    crc ^= 1;
+  }
+  out.push_back(crc & 0xFF);
+  out.push_back(crc >> 8);
+}
+
+// Frames written by a controller to a pty, through the ingest server, onto the sign
+// A raw pty for a pretend controller to send packets into, its fd; master gets the other end
+static int openController(int &master)
+{
+  std::string slaveName;
+  master = openPty(slaveName);
+  int controller = (master >= 0) ? open(slaveName.c_str(), O_RDWR | O_NOCTTY) : -1;
+  if (controller < 0) {
+    return -1;
+  }
+  struct termios raw;
+  tcgetattr(controller, &raw);
+  cfmakeraw(&raw);
+  tcsetattr(controller, TCSANOW, &raw);
+  return controller;
+}
+
+static bool checkIngest()
+{
+  int master;
+  int controller = openController(master);
+  if (controller < 0) {
+    printf("FAIL ingest, no pty\n");
+    return false;
+  }
+
+  SignSimulator sim;
+  simulator = &sim;
+  mcpFrontSign sign(19200);
+  mcpIngestServer<98> ingest(sign, Serial);
+  Serial.begin(115200);
+  sign.InitSign();
+
+  // Frame 0 is shown straight away. While it is being sent, frames 1 and 2, a patch
+  // on frame 2, a packet with a bad CRC and one off the edge of the sign come in.
+  // Frame 1 is stale by the time the sign is free, frame 2 and the patch are shown.
+  uint16_t frames[3][98];
+  randomSeed(17);
+  for (int f = 0; f < 3; f++) {
+    for (int x = 0; x < 98; x++) {
+      frames[f][x] = random(0x10000);
+    }
+  }
+  uint16_t patch[4] = { 0xFFFF, 0x0000, 0xFFFF, 0x0000 };
+  std::vector<uint8_t> wire;
+  ingestPacket(wire, 0, frames[0], 98);
+  ingestPacket(wire, 0, frames[1], 98);
+  ingestPacket(wire, 0, frames[2], 98);
+  ingestPacket(wire, 40, patch, 4);
+  ingestPacket(wire, 10, patch, 4, true);
+  ingestPacket(wire, 96, patch, 4);
+  if (write(controller, wire.data(), wire.size()) != (ssize_t)wire.size()) {
+    perror("write");
+  }
+  memcpy(&frames[2][40], patch, sizeof(patch));
+
+  unsigned long start = millis();
+  while (millis() - start < 5000) {
+    pumpIngestPty(master, Serial);
+    ingest.poll();
+    hostAdvanceMicros(100);
+  }
+  close(controller);
+  close(master);
+
+  int wrong = 0;
+  for (int x = 0; x < 98; x++) {
+    for (int y = 0; y < 16; y++) {
+      wrong += (sim.dot(x, y) != (bool)((frames[2][x] >> y) & 1));
+    }
+  }
+  mcpIngestStats stats = ingest.getStats();
+  printf("ingest %lu packets, %lu shown, %lu stale, %lu overruns, %lu bad CRCs, %lu bad headers\n",
+         stats.packets, stats.shown, stats.stale, stats.overruns, stats.badCrc, stats.badHeader);
+  if (wrong || stats.packets != 4 || stats.shown != 2 || stats.stale != 1 || stats.badCrc != 1 ||
+      stats.badHeader != 1 || sim.badLines || sim.badLrc) {
+    printf("FAIL ingest, %d dots differ\n", wrong);
+    sim.dumpAscii(stdout);
+    return false;
+  }
+  printf("ok   ingest\n");
+  return true;
+}
+
+// Six patches come in while a frame is being sent, more than the ring holds. The
+// oldest are drawn early instead of dropped, so the sign ends up with all of them.
+static bool checkIngestOverrun()
+{
+  int master;
+  int controller = openController(master);
+  if (controller < 0) {
+    printf("FAIL ingest overrun, no pty\n");
+    return false;
+  }
+
+  SignSimulator sim;
+  simulator = &sim;
+  mcpFrontSign sign(19200);
+  mcpIngestServer<98, 3> ingest(sign, Serial);
+  Serial.begin(115200);
+  sign.InitSign();
+
+  uint16_t frame[98];
+  randomSeed(23);
+  for (int x = 0; x < 98; x++) {
+    frame[x] = random(0x10000);
+  }
+  std::vector<uint8_t> wire;
+  ingestPacket(wire, 0, frame, 98);
+  for (int p = 0; p < 6; p++) {
+    uint16_t patch[5];
+    for (int i = 0; i < 5; i++) {
+      patch[i] = random(0x10000);
+    }
+    ingestPacket(wire, 3 + 15 * p, patch, 5);
+    memcpy(&frame[3 + 15 * p], patch, sizeof(patch));
+  }
+  if (write(controller, wire.data(), wire.size()) != (ssize_t)wire.size()) {
+    perror("write");
+  }
+
+  unsigned long start = millis();
+  while (millis() - start < 5000) {
+    pumpIngestPty(master, Serial);
+    ingest.poll();
+    hostAdvanceMicros(100);
+  }
+  close(controller);
+  close(master);
+
+  int wrong = 0;
+  for (int x = 0; x < 98; x++) {
+    for (int y = 0; y < 16; y++) {
+      wrong += (sim.dot(x, y) != (bool)((frame[x] >> y) & 1));
+    }
+  }
+  mcpIngestStats stats = ingest.getStats();
+  printf("ingest overrun: %lu packets, %lu shown, %lu drawn early, %d dots wrong\n",
+         stats.packets, stats.shown, stats.overruns, wrong);
+  if (wrong || stats.packets != 7 || stats.shown != 2 || stats.overruns != 4 || sim.badLines || sim.badLrc) {
+    printf("FAIL ingest overrun\n");
+    sim.dumpAscii(stdout);
+    return false;
+  }
+  return true;
+}
+
+// Random shapes drawn with the column mask overrides and with Adafruit_GFX's own
+// (mcpStrip has only drawPixel()), which have to come out the same
+static bool checkRaster()
+{
+  SignSimulator sim;
+  simulator = &sim;
+  mcpFrontSign sign(19200);
+  mcpScrollStrip<98> strip;
+  sign.InitSign();
+
+  randomSeed(5);
+  int wrong = 0;
+  for (int i = 0; i < 400; i++) {
+    int16_t x = random(-20, 118);
+    int16_t y = random(-10, 26);
+    int16_t w = random(-20, 40);
+    int16_t h = random(-20, 24);
+    uint16_t color = random(2);
+    Adafruit_GFX *targets[2] = { &sign, &strip };
+    for (int t = 0; t < 2; t++) {
+      switch (i % 6) {
+        case 0: targets[t]->fillRect(x, y, w, h, color); break;
+        case 1: targets[t]->drawFastVLine(x, y, h, color); break;
+        case 2: targets[t]->drawFastHLine(x, y, w, color); break;
+        case 3: targets[t]->drawRect(x, y, w, h, color); break;
+        case 4: targets[t]->fillCircle(x, y, abs(h) / 2, color); break;
+        case 5: targets[t]->drawLine(x, y, x + w, y + h, color); break;
+      }
+    }
+    for (int cx = 0; cx < 98; cx++) {
+      for (int cy = 0; cy < 16; cy++) {
+        wrong += sign.getPixel(cx, cy) != (bool)((strip.getColumns()[cx] >> cy) & 1);
+      }
+    }
+  }
+  sign.UpdateSign();
+  verify(sign, "raster");
+
+  // Blit modes against the same columns combined by hand
+  uint16_t before[98];
+  uint16_t pattern[10];
+  for (int x = 0; x < 98; x++) {
+    before[x] = sign.getPixel(x, 0) ? 0x0F0F : 0xAAAA;
+  }
+  for (int x = 0; x < 10; x++) {
+    pattern[x] = 0x1234 * (x + 1);
+  }
+  const mcpBlitMode modes[4] = { mcpBlitCopy, mcpBlitOr, mcpBlitAnd, mcpBlitXor };
+  for (int m = 0; m < 4; m++) {
+    sign.drawColumns(0, before, 98);
+    sign.drawColumns(-3, pattern, 10, modes[m]);
+    sign.drawColumns(94, pattern, 10, modes[m]);
+    for (int x = 0; x < 98; x++) {
+      uint16_t expected = before[x];
+      int p = (x < 7) ? x + 3 : (x >= 94) ? x - 94 : -1;
+      if (p >= 0) {
+        uint16_t c = pattern[p];
+        expected = (m == 0) ? c : (m == 1) ? (expected | c) : (m == 2) ? (expected & c) : (expected ^ c);
+      }
+      for (int y = 0; y < 16; y++) {
+        wrong += sign.getPixel(x, y) != (bool)((expected >> y) & 1);
+      }
+    }
+  }
+
+  // How long a screenful of small rectangles takes each way
+  unsigned long start = hostProfileMicros();
+  for (int i = 0; i < 1000; i++) {
+    sign.fillRect(i % 90, i % 10, 8, 6, i & 1);
+  }
+  unsigned long masks = hostProfileMicros() - start;
+  start = hostProfileMicros();
+  for (int i = 0; i < 1000; i++) {
+    strip.fillRect(i % 90, i % 10, 8, 6, i & 1);
+  }
+  unsigned long dots = hostProfileMicros() - start;
+  printf("1000 8x6 fillRect()s in %lu us with column masks, %lu us a dot at a time\n", masks, dots);
+
+  if (wrong) {
+    printf("FAIL raster, %d dots differ from Adafruit_GFX\n", wrong);
+    return false;
+  }
+  return true;
+}
+
+// The timing model against the virtual clock, and the pacer with the sign too slow,
+// fast enough, and settling between frames
+static bool checkPacer()
+{
+  SignSimulator sim;
+  simulator = &sim;
+  mcpFrontSign sign(19200);
+  sign.InitSign();
+  bool ok = true;
+
+  unsigned long start = micros();
+  sign.UpdateSign(true);
+  unsigned long measured = micros() - start;
+  unsigned long estimate = sign.estimateUpdateMicros(0x7FFF);
+  ok = ok && measured - estimate + 2000 <= 4000 && sign.nextFrameDeadline() <= millis();
+  printf("full update %lu us, estimated %lu us\n", measured, estimate);
+
+  // 10 fps of full updates, which take over half a second each
+  mcpPacer pacer(sign);
+  pacer.setTargetFps(10);
+  start = millis();
+  for (int i = 0; i < 6; i++) {
+    pacer.waitForFrame();
+    sign.dotAllOff();
+    sign.fillCircle(pacer.getFrameNumber() % 98, 7, 5, 1);
+    sign.UpdateSign(true);
+    verify(sign, "pacer-slow");
+  }
+  mcpPacerStats slow = pacer.getStats();
+  unsigned long slowFrame = pacer.getFrameNumber();
+  unsigned long slowElapsed = millis() - start;
+  ok = ok && slow.frames == 6 && slow.late == 5 && slow.dropped > 20 && slowFrame == 5 + slow.dropped;
+
+  // 4 fps of one moving dot, sent through present() while the pacer ticks the sign
+  pacer.setTargetFps(4);
+  pacer.resetStats();
+  unsigned long first = 0;
+  unsigned long last = 0;
+  for (int i = 0; i < 8; i++) {
+    pacer.waitForFrame();
+    last = millis();
+    if (i == 0) {
+      first = last;
+    }
+    sign.dotAllOff();
+    sign.drawPixel(i, 3, 1);
+    sign.present();
+  }
+  sign.WaitUntilIdle();
+  verify(sign, "pacer-fast");
+  mcpPacerStats fast = pacer.getStats();
+  unsigned long fastElapsed = last - first;
+  ok = ok && fast.frames == 8 && fast.late == 0 && fast.dropped == 0 && fastElapsed == 1750;
+
+  // An hour with no frames: the slots that passed are dropped, and the schedule starts again
+  unsigned long beforeGap = pacer.getFrameNumber();
+  delay(3600000UL);
+  pacer.resetStats();
+  pacer.waitForFrame();
+  unsigned long resumed = millis();
+  mcpPacerStats gapStats = pacer.getStats();
+  ok = ok && gapStats.dropped == 4UL * 3600 - 1 && pacer.getFrameNumber() == beforeGap + 4UL * 3600;
+  pacer.waitForFrame();
+  ok = ok && millis() - resumed == 250 && pacer.getStats().dropped == gapStats.dropped;
+
+  // As fast as the sign goes, with 300 ms for the dots to settle after each update
+  sign.setSettleTime(300);
+  pacer.setTargetFps(0);
+  pacer.resetStats();
+  unsigned long previous = 0;
+  unsigned long gap = 0;
+  for (int i = 0; i < 4; i++) {
+    pacer.waitForFrame();
+    gap = millis() - previous;
+    previous = millis();
+    sign.drawPixel(i, 5, 1);
+    sign.UpdateSign();
+  }
+  verify(sign, "pacer-settle");
+  unsigned long oneRegister = (sign.estimateUpdateMicros(1) + 999) / 1000;
+  ok = ok && gap + 2 >= oneRegister + 300 && gap <= oneRegister + 302 && pacer.getStats().late == 0;
+
+  printf("pacer at 10 fps: %lu frames, %lu late, %lu dropped in %lu ms; at 4 fps: %lu late, %lu dropped, "
+         "8 frames in %lu ms, %lu dropped over an hour idle; settling: %lu ms a frame, %lu ms of it the update\n",
+         slow.frames, slow.late, slow.dropped, slowElapsed, fast.late, fast.dropped, fastElapsed, gapStats.dropped, gap,
+         oneRegister);
+  if (!ok || sim.badLines || sim.badLrc) {
+    printf("FAIL pacer\n");
+    return false;
+  }
+  return true;
+}
+
+// Collects what printStats() prints
+class BufferPrint : public Print
+{
+  public:
+    BufferPrint() : length(0) { text[0] = 0; }
+    size_t write(uint8_t c)
+    {
+      if (length + 1 >= sizeof(text)) {
+        return 0;
+      }
+      text[length++] = c;
+      text[length] = 0;
+      return 1;
+    }
+    char text[1024];
+    size_t length;
+};
+
+// Register, reply and worst case counters, and their dump
+static bool checkTelemetry()
+{
+  SignSimulator sim;
+  simulator = &sim;
+  sim.setReplies(&Serial3);
+  mcpFrontSign sign(19200);
+  sign.InitSign();
+  delay(2 * eolDelay); // Let the last answer arrive
+  sign.ReadReplies();
+  sign.resetProfile();
+  sign.resetLinkStats();
+  bool ok = true;
+
+  unsigned long start = hostProfileMicros();
+  sign.UpdateSign(true);
+  unsigned long full = hostProfileMicros() - start;
+
+  // Noise on the line before the next answers is counted, and does not upset them
+  static const uint8_t noise[] = "\x7f\x00junk\r\n";
+  Serial3.hostInject(noise, sizeof(noise) - 1);
+  sign.drawPixel(40, 3, 1);
+  sign.UpdateSign();
+  sign.drawPixel(90, 3, 1);
+  sign.UpdateSign();
+  delay(2 * eolDelay);
+  sign.ReadReplies();
+  sim.setReplies(NULL);
+  verify(sign, "telemetry");
+
+  mcpProfile profile = sign.getProfile();
+  mcpLinkStats link = sign.getLinkStats();
+  BufferPrint out;
+  sign.printStats(out);
+  char expect[64];
+  ok = ok && link.acks > 0 && link.naks == 0 && link.badLrc == 0; // The noise upset no answer
+  snprintf(expect, sizeof(expect), "\nacks %lu\r\n", link.acks);
+  ok = ok && strstr(out.text, expect) != NULL && strncmp(out.text, "framesPresented 0\r\n", 19) == 0;
+#if MCP_PROFILE
+  ok = ok && profile.updates == 3 && profile.registersSent == 15 + 1 + 1 &&
+       profile.registersSent + profile.registersSkipped == 3 * 15;
+  ok = ok && profile.worstUpdateMicros <= full && profile.worstUpdateMicros + 5000 > full;
+  ok = ok && profile.discardedBytes == sizeof(noise) - 1 && profile.replyBytes > profile.discardedBytes;
+  ok = ok && link.acks == profile.lines;
+  snprintf(expect, sizeof(expect), "\nregistersSent %lu\r\n", profile.registersSent);
+  ok = ok && strstr(out.text, expect) != NULL && strstr(out.text, "\ndiscardedBytes 8\r\n") != NULL;
+#else
+  // Compiled out: nothing counted, and only the frame, link and line cache counters printed
+  static const mcpProfile zero = {};
+  ok = ok && memcmp(&profile, &zero, sizeof(profile)) == 0 && strstr(out.text, "registersSent") == NULL;
+#endif
+
+  printf("telemetry: %lu registers sent, %lu skipped, worst update %lu us of %lu us, "
+         "%lu reply bytes, %lu discarded\n", profile.registersSent, profile.registersSkipped,
+         profile.worstUpdateMicros, full, profile.replyBytes, profile.discardedBytes);
+  if (!ok || sim.badLines || sim.badLrc) {
+    printf("%s", out.text);
+    printf("FAIL telemetry\n");
+    return false;
+  }
+  return true;
+}
+
+// Column bitmaps decoded at odd places and in each mode, against the same columns drawn dot by
+// dot. The last image is saved as a PBM for 'make check' to run through flipdot_pack --bitmap.
+static bool checkBitmap()
+{
+  SignSimulator sim;
+  simulator = &sim;
+  mcpFrontSign sign(19200);
+  sign.InitSign();
+
+  // Long blank and barred stretches (runs longer than one count byte holds), and noise
+  const int width = 300;
+  const int height = 12;
+  std::vector<uint16_t> columns(width);
+  randomSeed(7);
+  for (int x = 0; x < width; x++) {
+    if (x >= 135 && x < 270) {
+      columns[x] = random(0, 0x10000);
+    } else if (x >= 60 && x < 70) {
+      columns[x] = 0x0FF0;
+    }
+  }
+  BitmapBuilder builder(&columns[0], width, height);
+  const mcpBitmap &bitmap = builder.build();
+
+  static const mcpBlitMode modes[] = {mcpBlitCopy, mcpBlitOr, mcpBlitAnd, mcpBlitXor};
+  randomSeed(8);
+  int wrong = 0;
+  for (int i = 0; i < 200 && !wrong; i++) {
+    int16_t x = random(-width, 110);
+    int16_t y = random(-14, 18);
+    mcpBlitMode mode = modes[i % 4];
+    std::vector<uint16_t> before(sign.width());
+    for (int c = 0; c < sign.width(); c++) {
+      before[c] = random(0, 0x10000);
+    }
+    sign.drawColumns(0, &before[0], sign.width());
+    sign.drawColumnBitmap(x, y, bitmap, mode);
+    for (int sx = 0; sx < sign.width(); sx++) {
+      for (int sy = 0; sy < sign.height(); sy++) {
+        bool dot = (before[sx] >> sy) & 1;
+        int bx = sx - x;
+        int by = sy - y;
+        if (bx >= 0 && bx < width && by >= 0 && by < height) {
+          bool bit = (columns[bx] >> by) & 1;
+          dot = (mode == mcpBlitCopy) ? bit : (mode == mcpBlitOr) ? (dot || bit) :
+                (mode == mcpBlitAnd) ? (dot && bit) : (dot != bit);
+        }
+        if (sign.getPixel(sx, sy) != dot) {
+          wrong++;
+        }
+      }
+    }
+  }
+  sign.UpdateSign(true);
+  verify(sign, "bitmap");
+  char path[512];
+  snprintf(path, sizeof(path), "%s/bitmap.pbm", outDir);
+  bool written = sim.writePbm(path);
+  if (!written) {
+    perror(path);
+  }
+
+  size_t rows = (width + 7) / 8 * height;
+  printf("bitmap %dx%d: %lu bytes (%lu as rows of dots), %d dots wrong\n", width, height,
+         (unsigned long)builder.size(), (unsigned long)rows, wrong);
+  if (!written || wrong || builder.size() >= rows || sim.badLines || sim.badLrc) {
+    printf("FAIL bitmap\n");
+    return false;
+  }
+  return true;
+}
+
+// Adafruit_GFX row bitmaps drawn by mcp's transposing overrides and by Adafruit_GFX itself
+// onto a strip (drawPixel() only), at random places, sizes and colors
+static bool checkRowBitmaps()
+{
+  SignSimulator sim;
+  simulator = &sim;
+  mcpFrontSign sign(19200);
+  mcpScrollStrip<98> strip;
+  sign.InitSign();
+
+  randomSeed(9);
+  uint8_t bitmap[40 * 24];
+  int wrong = 0;
+  for (int i = 0; i < 600; i++) {
+    int16_t w = random(1, 41);
+    int16_t h = random(1, 25);
+    int16_t x = random(-45, 100);
+    int16_t y = random(-26, 18);
+    uint16_t color = random(3); // 2 is off, as in drawPixel()
+    uint16_t bg = random(2);
+    uint8_t threshold = random(256);
+    for (size_t b = 0; b < sizeof(bitmap); b++) {
+      bitmap[b] = (i % 8 == 6) ? random(0, 3) : random(0, 256); // Grayscale 1s are dots on
+    }
+    Adafruit_GFX &gfx = strip;
+    switch (i % 8) {
+      case 0:
+        sign.drawBitmap(x, y, (const uint8_t *)bitmap, w, h, color);
+        gfx.drawBitmap(x, y, (const uint8_t *)bitmap, w, h, color);
+        break;
+      case 1:
+        sign.drawBitmap(x, y, (const uint8_t *)bitmap, w, h, color, bg);
+        gfx.drawBitmap(x, y, (const uint8_t *)bitmap, w, h, color, bg);
+        break;
+      case 2:
+        sign.drawBitmap(x, y, bitmap, w, h, color);
+        gfx.drawBitmap(x, y, bitmap, w, h, color);
+        break;
+      case 3:
+        sign.drawBitmap(x, y, bitmap, w, h, color, bg);
+        gfx.drawBitmap(x, y, bitmap, w, h, color, bg);
+        break;
+      case 4:
+        sign.drawXBitmap(x, y, bitmap, w, h, color);
+        gfx.drawXBitmap(x, y, bitmap, w, h, color);
+        break;
+      case 5:
+        sign.drawGrayscaleBitmap(x, y, (const uint8_t *)bitmap, w, h);
+        gfx.drawGrayscaleBitmap(x, y, (const uint8_t *)bitmap, w, h);
+        break;
+      case 6:
+        sign.drawGrayscaleBitmap(x, y, bitmap, w, h);
+        gfx.drawGrayscaleBitmap(x, y, bitmap, w, h);
+        break;
+      case 7:
+        // The threshold against the same image, thresholded first
+        sign.drawGrayscaleBitmap(x, y, bitmap, w, h, threshold);
+        for (int b = 0; b < w * h; b++) {
+          bitmap[b] = bitmap[b] >= threshold ? 1 : 0;
+        }
+        gfx.drawGrayscaleBitmap(x, y, bitmap, w, h);
+        break;
+    }
+    for (int cx = 0; cx < 98; cx++) {
+      for (int cy = 0; cy < 16; cy++) {
+        wrong += sign.getPixel(cx, cy) != (bool)((strip.getColumns()[cx] >> cy) & 1);
+      }
+    }
+  }
+  sign.UpdateSign();
+  verify(sign, "row-bitmaps");
+
+  // How long a full screen bitmap takes each way
+  for (size_t b = 0; b < sizeof(bitmap); b++) {
+    bitmap[b] = random(0, 256);
+  }
+  unsigned long start = hostProfileMicros();
+  for (int i = 0; i < 100; i++) {
+    sign.drawBitmap(0, 0, bitmap, 98, 16, 1, 0);
+  }
+  unsigned long blocks = hostProfileMicros() - start;
+  start = hostProfileMicros();
+  for (int i = 0; i < 100; i++) {
+    ((Adafruit_GFX &)strip).drawBitmap(0, 0, bitmap, 98, 16, 1, 0);
+  }
+  unsigned long dots = hostProfileMicros() - start;
+  printf("100 98x16 drawBitmap()s in %lu us 8x8 at a time, %lu us a dot at a time\n", blocks, dots);
+
+  if (wrong) {
+    printf("FAIL row-bitmaps, %d dots differ from Adafruit_GFX\n", wrong);
+    return false;
+  }
+  return true;
+}
+
+static int zoneMinute; // What the zone check's clock shows
+static unsigned long zoneRenders;
+
+static void drawZoneClock(mcpZone &zone)
+{
+  zoneRenders++;
+  zone.fillScreen(0);
+  zone.setCursor(4, 4);
+  zone.print("12:");
+  zone.print(zoneMinute);
+}
+
+// A static route number and a clock redrawn every second that changes every third, through
+// mcpZones: the route number goes out once, and the clock only when it shows something new
+static bool checkZones()
+{
+  SignSimulator sim;
+  simulator = &sim;
+  mcpFrontSign sign(19200);
+  sign.InitSign();
+  mcpSignZone<30> route(0, 0, 16, "route");
+  mcpSignZone<68> clock(30, 2, 12, "clock");
+  mcpZones zones(sign);
+  bool ok = zones.add(route) && zones.add(clock) && zones.find("clock") == &clock && zones.find("x") == NULL;
+
+  zoneMinute = 34;
+  zoneRenders = 0;
+  clock.setRefresh(1000, drawZoneClock);
+  route.setCursor(2, 4);
+  route.setTextSize(2);
+  route.print("42");
+  unsigned long writesBefore = sim.registerWrites;
+  zones.flush();
+  uint16_t routeRegisters = sign.getRegionRegisters(0, 29);
+  uint16_t clockRegisters = sign.getRegionRegisters(30, 97);
+  unsigned long both = 0;
+  for (uint16_t r = routeRegisters | clockRegisters; r; r &= r - 1) {
+    both++;
+  }
+  ok = ok && zones.getUpdates() == 1 && zones.getRegistersSent() == both;
+
+  // Ten seconds of the clock, with the route number drawn again the same in between
+  unsigned long clockOnly = 0;
+  for (uint16_t r = clockRegisters; r; r &= r - 1) {
+    clockOnly++;
+  }
+  unsigned long end = millis() + 10000;
+  unsigned long ticks = 0;
+  while ((long)(millis() - end) < 0) {
+    zones.tick();
+    if (++ticks % 5000 == 0) {
+      route.setCursor(2, 4);
+      route.print("42");
+    }
+    if (zoneRenders % 3 == 0) {
+      zoneMinute = 34 + zoneRenders / 3;
+    }
+    yield();
+  }
+  zones.flush();
+  unsigned long updates = zones.getUpdates() - 1;
+  ok = ok && zoneRenders == 11 && updates == 3 && zones.getRegistersSent() == both + updates * clockOnly;
+  ok = ok && sim.registerWrites - writesBefore == zones.getRegistersSent();
+  verify(sign, "zones");
+
+  // The same picture drawn on the sign in one go
+  mcpFrontSign reference(19200);
+  reference.setTextColor(1);
+  reference.setCursor(2, 4);
+  reference.setTextSize(2);
+  reference.print("42");
+  reference.setTextSize(1);
+  reference.setCursor(34, 6);
+  reference.print("12:");
+  reference.print(zoneMinute);
+  int wrong = 0;
+  for (int x = 0; x < 98; x++) {
+    for (int y = 0; y < 16; y++) {
+      wrong += sign.getPixel(x, y) != reference.getPixel(x, y);
+    }
+  }
+
+  printf("zones: %lu clock renders, %lu updates of %lu registers after the first, %d dots wrong\n",
+         zoneRenders, updates, clockOnly, wrong);
+  if (!ok || wrong || sim.badLines || sim.badLrc) {
+    printf("FAIL zones\n");
+    return false;
+  }
+  return true;
+}
+
+static void feedSimulator(void *context, const uint8_t *data, size_t size)
+{
+  ((SignSimulator *)context)->feed(data, size);
+}
+
+// The same image through an in-memory loopback, and through a pty with one writev() per line
+static bool checkTransport()
+{
+  SignSimulator loopSim;
+  mcpLoopbackTransport loopback;
+  loopback.setListener(feedSimulator, &loopSim);
+  mcpFrontSign loopSign(19200, loopback);
+  simulator = &loopSim;
+  loopSign.InitSign();
+  loopSign.setTextColor(1);
+  loopSign.setCursor(2, 4);
+  loopSign.print("Loopback");
+  loopSign.UpdateSign();
+  verify(loopSign, "loopback");
+
+  std::string slaveName;
+  int master = openPty(slaveName);
+  TermiosTransport tty;
+  if (master < 0 || !tty.open(slaveName.c_str())) {
+    printf("FAIL transport, no pty\n");
+    return false;
+  }
+  SignSimulator ptySim;
+  mcpFrontSign ptySign(19200, tty);
+  simulator = &ptySim;
+  ptySign.InitSign();
+  ptySign.fillCircle(30, 7, 6, 1);
+  ptySign.UpdateSign();
+  uint8_t buffer[256];
+  ssize_t n;
+  while ((n = read(master, buffer, sizeof(buffer))) > 0) {
+    ptySim.feed(buffer, n);
+  }
+  verify(ptySign, "pty");
+
+  // On the real clock, as a gateway runs it, the line delays have to pass for real
+  hostRealTime(true);
+  ptySign.fillRect(2, 2, 4, 4, 1);
+  uint16_t registers = ptySign.getRegionRegisters(2, 5);
+  unsigned long estimate = ptySign.estimateUpdateMicros(registers);
+  struct timespec before, after;
+  clock_gettime(CLOCK_MONOTONIC, &before);
+  ptySign.updateRegisters(registers);
+  clock_gettime(CLOCK_MONOTONIC, &after);
+  hostRealTime(false);
+  unsigned long elapsed = (after.tv_sec - before.tv_sec) * 1000000L + (after.tv_nsec - before.tv_nsec) / 1000;
+  while ((n = read(master, buffer, sizeof(buffer))) > 0) {
+    ptySim.feed(buffer, n);
+  }
+  verify(ptySign, "pty-real-time");
+  tty.close();
+  close(master);
+
+  printf("loopback %lu lines, pty %lu lines in %lu writev() calls, real time update %lu us, estimated %lu us\n",
+         loopback.linesWritten, ptySim.linesReceived, tty.writeCalls, elapsed, estimate);
+  if (loopback.linesWritten != loopSim.linesReceived || tty.writeCalls != ptySim.linesReceived || elapsed < estimate ||
+      loopSim.badLines || loopSim.badLrc || ptySim.badLines || ptySim.badLrc) {
+    printf("FAIL transport\n");
+    return false;
+  }
+  return true;
+}
+
+// Front, side and rear signs on one line, each simulator hears everything
+static SignSimulator *busSimulators[3];
+
+static void busTx(void *context, const uint8_t *data, size_t size)
+{
+  (void)context;
+  for (int i = 0; i < 3; i++) {
+    busSimulators[i]->feed(data, size);
+  }
+}
+
+static void drawBusFrame(mcp **signs, int frame)
+{
+  for (int i = 0; i < 3; i++) {
+    signs[i]->dotAllOff();
+    signs[i]->fillCircle((frame * 11 + i * 5) % signs[i]->width(), 7, 5, 1);
+    signs[i]->drawFastVLine(signs[i]->width() - 1 - frame, 0, signs[i]->height(), 1);
+  }
+}
+
+// The same frames sent one sign after the other, then through mcpBus. Each simulated
+// sign needs nearly the whole line delay after a line for it, so the bus must keep to
+// every sign's delay while it fills the gaps with lines for the others.
+static bool checkBus()
+{
+  SignSimulator front;
+  SignSimulator side(112, 0, 0, 7);
+  SignSimulator rear(28, 0, 0, 8);
+  SignSimulator *sims[3] = {&front, &side, &rear};
+  for (int i = 0; i < 3; i++) {
+    busSimulators[i] = sims[i];
+    sims[i]->setReplies(&Serial3);
+    sims[i]->processMicros = (eolDelay - 1) * 1000UL;
+  }
+  Serial3.hostSetTxListener(busTx, NULL);
+
+  mcpFrontSign frontSign(19200);
+  mcpSign<112, 7> sideSign(19200);
+  mcpSign<28, 8> rearSign(19200);
+  mcp *signs[3] = {&frontSign, &sideSign, &rearSign};
+  static const char *const names[3] = {"bus-front", "bus-side", "bus-rear"};
+  mcpBus bus;
+  for (int i = 0; i < 3; i++) {
+    signs[i]->InitSign();
+    signs[i]->setEndOfUpdateDelay(100); // Time for the dots to flip
+    bus.addSign(*signs[i]);
+  }
+
+  unsigned long start = millis();
+  for (int frame = 0; frame < 3; frame++) {
+    drawBusFrame(signs, frame);
+    for (int i = 0; i < 3; i++) {
+      signs[i]->UpdateSign(true);
+      simulator = sims[i];
+      verify(*signs[i], names[i]);
+    }
+  }
+  unsigned long sequentialMs = millis() - start;
+
+  start = millis();
+  for (int frame = 3; frame < 6; frame++) {
+    drawBusFrame(signs, frame);
+    bus.UpdateSigns(true);
+    for (int i = 0; i < 3; i++) {
+      simulator = sims[i];
+      verify(*signs[i], names[i]);
+    }
+  }
+  unsigned long busMs = millis() - start;
+
+  // Only some registers change, asynchronously
+  drawBusFrame(signs, 6);
+  bus.beginUpdate();
+  while (bus.isBusy()) {
+    bus.tick();
+    hostAdvanceMicros(100);
+  }
+  for (int i = 0; i < 3; i++) {
+    simulator = sims[i];
+    verify(*signs[i], names[i]);
+  }
+
+  bool ok = true;
+  for (int i = 0; i < 3; i++) {
+    ok = ok && sims[i]->linesMissed == 0 && sims[i]->badLines == 0 && sims[i]->badLrc == 0 &&
+         sims[i]->linesIgnored > 0;
+    sims[i]->setReplies(NULL);
+  }
+  printf("3 signs one after the other %lu ms, on the bus %lu ms; %lu, %lu and %lu lines missed\n",
+         sequentialMs, busMs, front.linesMissed, side.linesMissed, rear.linesMissed);
+  if (!ok || busMs >= sequentialMs) {
+    printf("FAIL bus\n");
+    ok = false;
+  }
+  Serial3.hostSetTxListener(recordTx, NULL);
+  return ok;
+}
+
+static int runCheck(const char *transcriptPath)
+{
+  if (transcriptPath) {
+    transcript = fopen(transcriptPath, "wb");
+    if (!transcript) {
+      perror(transcriptPath);
+      return 2;
+    }
+  }
+
+  SignSimulator sim;
+  simulator = &sim;
+  Serial3.hostSetTxListener(recordTx, NULL);
+
+  mcpFrontSign sign(19200);
+  sign.InitSign();
+
+  sign.dotAllOn();
+  sign.UpdateSign();
+  verify(sign, "all-on");
+
+  sign.dotAllOff();
+  sign.UpdateSign();
+  verify(sign, "all-off");
+
+  sign.setTextColor(1);
+  sign.setTextSize(1);
+  sign.setCursor(1, 1);
+  sign.println("Line one.");
+  sign.print("The second line.");
+  sign.UpdateSign();
+  verify(sign, "text");
+
+  sign.dotAllOff();
+  sign.setTextSize(2);
+  sign.setCursor(1, 1);
+  sign.print(1234567UL);
+  sign.UpdateSign();
+  verify(sign, "text-2x");
+
+  for (int i = 0; i < sign.width(); i += 7) {
+    sign.dotAllOff();
+    sign.fillCircle(i, 7, 5, 1);
+    sign.UpdateSign();
+    verify(sign, "circle");
+  }
+
+  randomSeed(42);
+  for (int frame = 0; frame < 3; frame++) {
+    for (int x = 0; x < sign.width(); x++) {
+      for (int y = 0; y < sign.height(); y++) {
+        sign.drawPixel(x, y, random(2));
+      }
+    }
+    sign.UpdateSign();
+    verify(sign, "noise");
+  }
+
+  sign.invertAll();
+  sign.beginUpdate();
+  while (sign.isBusy()) {
+    sign.tick();
+    hostAdvanceMicros(100);
+  }
+  verify(sign, "invert-async");
+
+  if (transcript) {
+    fclose(transcript);
+    transcript = NULL;
+  }
+
+  printf("%lu lines, %lu register writes, %lu frames displayed, %lu bad lines, %lu bad LRCs, %lu ms virtual time\n",
+         sim.linesReceived, sim.registerWrites, sim.framesDisplayed, sim.badLines, sim.badLrc, millis());
+
+  // The side and rear sign sizes, the IDs here are only for the simulation
+  SignSimulator side(112, 0, 0, 7);
+  SignSimulator rear(28, 0, 0, 8);
+  bool layoutsOk = checkLayout<mcpSign<112, 7> >("side-112", side);
+  layoutsOk = checkLayout<mcpSign<28, 8> >("rear-28", rear) && layoutsOk;
+
+  bool pacingOk = checkPacing();
+  bool rejectedOk = checkRejectedRegister();
+  bool calibrationOk = checkCalibration();
+  bool busOk = checkBus();
+  bool scrollOk = checkScroller();
+  bool textOk = checkText();
+  bool packOk = checkPack();
+  bool lineCacheOk = checkLineCache();
+  bool regionOk = checkRegion();
+  bool ingestOk = checkIngest();
+  ingestOk = checkIngestOverrun() && ingestOk;
+  bool transportOk = checkTransport();
+  bool rasterOk = checkRaster();
+  bool pacerOk = checkPacer();
+  bool telemetryOk = checkTelemetry();
+  bool bitmapOk = checkBitmap();
+  bool rowBitmapsOk = checkRowBitmaps();
+  bool zonesOk = checkZones();
+
+  return (mismatches || sim.badLines || sim.badLrc || !layoutsOk || !pacingOk || !rejectedOk || !calibrationOk ||
+          !busOk ||
+          !scrollOk || !textOk || !packOk || !lineCacheOk ||
+          !regionOk || !ingestOk || !transportOk ||
+          !rasterOk || !pacerOk || !telemetryOk ||
+          !bitmapOk || !rowBitmapsOk || !zonesOk) ? 1 : 0;
+}
+
+static int runDecode(const char *pbmPath)
+{
+  SignSimulator sim;
+  uint8_t buffer[512];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), stdin)) > 0) {
+    sim.feed(buffer, n);
+  }
+  sim.feed((const uint8_t *)"\n", 1); // In case the capture ends without a line break
+
+  sim.dumpAscii(stdout);
+  printf("%lu lines, %lu register writes, %lu frames displayed, %lu bad lines, %lu bad LRCs\n",
+         sim.linesReceived, sim.registerWrites, sim.framesDisplayed, sim.badLines, sim.badLrc);
+  if (pbmPath && !sim.writePbm(pbmPath)) {
+    perror(pbmPath);
+    return 2;
+  }
+  return (sim.badLines || sim.badLrc) ? 1 : 0;
+}
+
+static int runServe()
+{
+  std::string slaveName;
+  int master = openPty(slaveName);
+  if (master < 0) {
+    return 2;
+  }
+  printf("ingest server on %s\n", slaveName.c_str());
+  fflush(stdout);
+
+  SignSimulator sim;
+  simulator = &sim;
+  Serial3.hostSetTxListener(recordTx, NULL);
+  mcpFrontSign sign(19200);
+  mcpIngestServer<98> ingest(sign, Serial);
+  Serial.begin(115200);
+  sign.InitSign();
+
+  // Virtual time runs at least as fast as real time, so the sign keeps up
+  unsigned long shown = sim.framesDisplayed;
+  for (;;) {
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(master, &readable);
+    struct timeval wait = { 0, 1000 };
+    select(master + 1, &readable, NULL, NULL, &wait);
+    if (!pumpIngestPty(master, Serial)) {
+      usleep(10000); // No controller has the pty open
+    }
+    ingest.poll();
+    hostAdvanceMicros(1000);
+    if (sim.framesDisplayed != shown) {
+      shown = sim.framesDisplayed;
+      mcpIngestStats stats = ingest.getStats();
+      sim.dumpAscii(stdout);
+      printf("%lu packets, %lu shown, %lu stale, %lu overruns, %lu bad CRCs, %lu bad headers\n", stats.packets,
+             stats.shown, stats.stale, stats.overruns, stats.badCrc, stats.badHeader);
+      fflush(stdout);
+    }
+  }
+}
+
+static int usage(const char *self)
+{
+  fprintf(stderr, "usage: %s check [--transcript file] [--out dir]\n", self);
+  fprintf(stderr, "       %s decode [--pbm file] < transcript\n", self);
+  fprintf(stderr, "       %s serve\n", self);
+  return 2;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc >= 2 && !strcmp(argv[1], "check")) {
+    const char *transcriptPath = NULL;
+    for (int arg = 2; arg < argc; arg += 2) {
+      if (arg + 1 >= argc) {
+        return usage(argv[0]);
+      }
+      if (!strcmp(argv[arg], "--transcript")) {
+        transcriptPath = argv[arg + 1];
+      } else if (!strcmp(argv[arg], "--out")) {
+        outDir = argv[arg + 1];
+      } else {
+        return usage(argv[0]);
+      }
+    }
+    return runCheck(transcriptPath);
+  }
+  if (argc != 2 && argc != 4) {
+    return usage(argv[0]);
+  }
+  const char *option = (argc == 4) ? argv[2] : NULL;
+  const char *path = (argc == 4) ? argv[3] : NULL;
+
+  if (!strcmp(argv[1], "decode") && (!option || !strcmp(option, "--pbm"))) {
+    return runDecode(path);
+  }
+  if (!strcmp(argv[1], "serve") && argc == 2) {
+    return runServe();
+  }
+  return usage(argv[0]);
+}
@@ -0,0 +1 @@
+// Empty stand-in: Adafruit_GFX.h includes this BusIO header, but nothing here needs it.
@@ -0,0 +1,87 @@
+/*
+   Minimal Arduino core shim for building the flipdot driver on a Linux host.
+
+   Only the pieces used by this sketch and by Adafruit_GFX are provided.
+   Time is virtual: delay() advances the clock instantly, and flushing the
+   serial port advances it by the time the bytes would spend on the wire.
+   hostRealTime(true) switches to the real clock, for driving a real sign.
+*/
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr) (*(void * const *)(addr))
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+#define bit(b) (1UL << (b))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield(void); // Lets a little virtual time pass, so busy-wait loops make progress
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+// Host-only: move the virtual clock forward without sleeping (in real time, sleep).
+void hostAdvanceMicros(unsigned long us);
+
+// Host-only: true to run millis(), micros() and the delays on CLOCK_MONOTONIC and
+// nanosleep(), as a gateway driving a real sign through TermiosTransport must, or the
+// line delays would take no time at all. false goes back to virtual time from where
+// the real clock got to.
+void hostRealTime(bool enabled);
+
+// Host-only: virtual time plus the real time this process has run for.
+// The Makefile uses it as MCP_PROFILE_MICROS, so CPU work shows up in the
+// driver's phase timing while delays and serial waits stay virtual.
+unsigned long hostProfileMicros(void);
+
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "HardwareSerial.h"
+
+#endif
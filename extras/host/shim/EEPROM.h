@@ -0,0 +1,39 @@
+/*
+   Host stand-in for the Arduino EEPROM library: 4KB kept in memory,
+   erased (all 0xFF) at startup like a fresh chip.
+*/
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include "Arduino.h"
+
+class EEPROMClass
+{
+  public:
+    EEPROMClass() { hostErase(); }
+    uint8_t read(int idx) { return data[idx]; }
+    void write(int idx, uint8_t value) { data[idx] = value; }
+    void update(int idx, uint8_t value) { data[idx] = value; }
+    uint16_t length() { return sizeof(data); }
+
+    template <typename T> T &get(int idx, T &t)
+    {
+      memcpy(&t, &data[idx], sizeof(T));
+      return t;
+    }
+    template <typename T> const T &put(int idx, const T &t)
+    {
+      memcpy(&data[idx], &t, sizeof(T));
+      return t;
+    }
+
+    // Host-only helper
+    void hostErase() { memset(data, 0xFF, sizeof(data)); }
+
+  private:
+    uint8_t data[4096];
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,105 @@
+#include "Arduino.h"
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+HardwareSerial Serial2;
+HardwareSerial Serial3;
+
+void HardwareSerial::begin(unsigned long baudRate)
+{
+  baud = baudRate ? baudRate : 9600;
+}
+
+int HardwareSerial::available()
+{
+  // Only bytes that have finished arriving
+  int count = 0;
+  unsigned long now = micros();
+  for (unsigned int i = rxTail; i != rxHead; i = (i + 1) % RX_BUFFER_SIZE) {
+    if ((long)(now - rxTime[i]) < 0) {
+      break;
+    }
+    count++;
+  }
+  return count;
+}
+
+int HardwareSerial::read()
+{
+  if (peek() < 0) {
+    return -1;
+  }
+  uint8_t c = rxBuffer[rxTail];
+  rxTail = (rxTail + 1) % RX_BUFFER_SIZE;
+  return c;
+}
+
+int HardwareSerial::peek()
+{
+  if (rxHead == rxTail || (long)(micros() - rxTime[rxTail]) < 0) {
+    return -1;
+  }
+  return rxBuffer[rxTail];
+}
+
+int HardwareSerial::availableForWrite()
+{
+  return 64;
+}
+
+void HardwareSerial::flush()
+{
+  // 1 start + 8 data + 1 stop bit per byte
+  unsigned long done = txStart + (unsigned long)((unsigned long long)unflushedBytes * 10 * 1000000 / baud);
+  long wait = (long)(done - micros());
+  if (wait > 0) {
+    hostAdvanceMicros(wait);
+  }
+  unflushedBytes = 0;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  // Bytes written once the port has gone idle start going out now
+  unsigned long now = micros();
+  unsigned long done = txStart + (unsigned long)((unsigned long long)unflushedBytes * 10 * 1000000 / baud);
+  if (unflushedBytes == 0 || (long)(now - done) >= 0) {
+    txStart = now;
+    unflushedBytes = 0;
+  }
+  bytesWritten += size;
+  unflushedBytes += size;
+  if (txListener) {
+    txListener(txContext, buffer, size);
+  }
+  return size;
+}
+
+void HardwareSerial::hostSetTxListener(TxListener listener, void *context)
+{
+  txListener = listener;
+  txContext = context;
+}
+
+void HardwareSerial::hostInject(const uint8_t *data, size_t size)
+{
+  hostInjectAt(micros(), data, size);
+}
+
+void HardwareSerial::hostInjectAt(unsigned long atMicros, const uint8_t *data, size_t size)
+{
+  for (size_t i = 0; i < size; i++) {
+    unsigned int next = (rxHead + 1) % RX_BUFFER_SIZE;
+    if (next == rxTail) {
+      return; // Overflow, drop like a real UART would
+    }
+    rxBuffer[rxHead] = data[i];
+    rxTime[rxHead] = atMicros + (unsigned long)((unsigned long long)i * 10 * 1000000 / baud);
+    rxHead = next;
+  }
+}
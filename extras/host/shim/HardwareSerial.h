@@ -0,0 +1,61 @@
+/*
+   Host stand-in for an Arduino HardwareSerial port.
+
+   Transmitted bytes are handed to an optional listener (the sign simulator
+   in this folder), and received bytes can be queued with hostInject().
+   flush() advances the virtual clock until the bytes written so far would
+   have left the port at the configured baud rate (10 bits/byte).
+*/
+#ifndef HardwareSerial_h
+#define HardwareSerial_h
+
+#include "Stream.h"
+
+class HardwareSerial : public Stream
+{
+  public:
+    typedef void (*TxListener)(void *context, const uint8_t *data, size_t size);
+
+    // constexpr so the global ports are ready before any sketch-level constructor runs
+    constexpr HardwareSerial()
+      : baud(9600), bytesWritten(0), unflushedBytes(0), txStart(0), txListener(NULL), txContext(NULL),
+        rxBuffer(), rxTime(), rxHead(0), rxTail(0) {}
+    void begin(unsigned long baud);
+    void end() {}
+    int available();
+    int read();
+    int peek();
+    int availableForWrite();
+    void flush();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    operator bool() { return true; }
+
+    // Host-only helpers
+    void hostSetTxListener(TxListener listener, void *context);
+    void hostInject(const uint8_t *data, size_t size);
+    void hostInjectAt(unsigned long atMicros, const uint8_t *data, size_t size); // First byte fully received at atMicros
+    unsigned long hostBaud() const { return baud; }
+    unsigned long hostBytesWritten() const { return bytesWritten; }
+
+  private:
+    enum { RX_BUFFER_SIZE = 1024 };
+    unsigned long baud;
+    unsigned long bytesWritten;
+    unsigned long unflushedBytes; // Written since txStart, possibly still going out
+    unsigned long txStart; // micros() when the port started sending unflushedBytes
+    TxListener txListener;
+    void *txContext;
+    uint8_t rxBuffer[RX_BUFFER_SIZE];
+    unsigned long rxTime[RX_BUFFER_SIZE]; // micros() at which each byte can be read
+    unsigned int rxHead;
+    unsigned int rxTail;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+
+#endif
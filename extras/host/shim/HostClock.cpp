@@ -0,0 +1,136 @@
+/*
+   Virtual clock and pin stubs for the host build, and the real clock for
+   driving real hardware (see hostRealTime()).
+*/
+#include "Arduino.h"
+#include <time.h>
+
+static unsigned long long hostMicros = 0; // The virtual clock
+static bool realTime = false;
+static long long realOffset = 0; // Added to the monotonic clock in real time, so time never goes back
+
+static unsigned long long monotonicMicros()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static unsigned long long nowMicros()
+{
+  return realTime ? (unsigned long long)(monotonicMicros() + realOffset) : hostMicros;
+}
+
+// Let us microseconds go by, sleeping in real time
+static void passMicros(unsigned long long us)
+{
+  if (!realTime) {
+    hostMicros += us;
+    return;
+  }
+  struct timespec wait;
+  wait.tv_sec = us / 1000000;
+  wait.tv_nsec = (us % 1000000) * 1000;
+  while (nanosleep(&wait, &wait) != 0) {
+  }
+}
+
+void hostRealTime(bool enabled)
+{
+  if (enabled == realTime) {
+    return;
+  }
+  if (enabled) {
+    realOffset = (long long)hostMicros - (long long)monotonicMicros();
+  } else {
+    hostMicros = nowMicros();
+  }
+  realTime = enabled;
+}
+
+unsigned long millis(void)
+{
+  return (unsigned long)(nowMicros() / 1000);
+}
+
+unsigned long micros(void)
+{
+  return (unsigned long)nowMicros();
+}
+
+void delay(unsigned long ms)
+{
+  passMicros((unsigned long long)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  passMicros(us);
+}
+
+void yield(void)
+{
+  passMicros(10);
+}
+
+void hostAdvanceMicros(unsigned long us)
+{
+  passMicros(us);
+}
+
+unsigned long hostProfileMicros(void)
+{
+  if (realTime) {
+    return micros();
+  }
+  return (unsigned long)(hostMicros + monotonicMicros());
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  (void)pin;
+  (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+  (void)pin;
+  (void)val;
+}
+
+int digitalRead(uint8_t pin)
+{
+  (void)pin;
+  return LOW;
+}
+
+static unsigned long randomState = 1;
+
+void randomSeed(unsigned long seed)
+{
+  if (seed != 0) {
+    randomState = seed;
+  }
+}
+
+long random(long howbig)
+{
+  if (howbig == 0) {
+    return 0;
+  }
+  // xorshift32, deterministic across hosts
+  unsigned long x = randomState & 0xFFFFFFFFUL;
+  x ^= (x << 13) & 0xFFFFFFFFUL;
+  x ^= x >> 17;
+  x ^= (x << 5) & 0xFFFFFFFFUL;
+  randomState = x;
+  return (long)(x % (unsigned long)howbig);
+}
+
+long random(long howsmall, long howbig)
+{
+  if (howsmall >= howbig) {
+    return howsmall;
+  }
+  return random(howbig - howsmall) + howsmall;
+}
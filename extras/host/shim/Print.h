@@ -0,0 +1,50 @@
+/*
+   Minimal Arduino Print shim for host builds.
+*/
+#ifndef Print_h
+#define Print_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "WString.h"
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *str);
+    size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const __FlashStringHelper *ifsh);
+    size_t print(const String &s);
+    size_t print(const char str[]);
+    size_t print(char c);
+    size_t print(unsigned char n, int base = DEC_BASE);
+    size_t print(int n, int base = DEC_BASE);
+    size_t print(unsigned int n, int base = DEC_BASE);
+    size_t print(long n, int base = DEC_BASE);
+    size_t print(unsigned long n, int base = DEC_BASE);
+    size_t print(double n, int digits = 2);
+
+    size_t println(const __FlashStringHelper *ifsh);
+    size_t println(const String &s);
+    size_t println(const char str[]);
+    size_t println(char c);
+    size_t println(unsigned char n, int base = DEC_BASE);
+    size_t println(int n, int base = DEC_BASE);
+    size_t println(unsigned int n, int base = DEC_BASE);
+    size_t println(long n, int base = DEC_BASE);
+    size_t println(unsigned long n, int base = DEC_BASE);
+    size_t println(double n, int digits = 2);
+    size_t println(void);
+
+  private:
+    enum { DEC_BASE = 10 };
+    size_t printNumber(unsigned long n, int base, bool negative);
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include "Arduino.h"
+
+String::String(const char *cstr) : buffer(NULL), capacity(0), len(0)
+{
+  assign(cstr ? cstr : "", cstr ? strlen(cstr) : 0);
+}
+
+String::String(const String &str) : buffer(NULL), capacity(0), len(0)
+{
+  assign(str.buffer, str.len);
+}
+
+String::String(const __FlashStringHelper *str) : buffer(NULL), capacity(0), len(0)
+{
+  const char *cstr = reinterpret_cast<const char *>(str);
+  assign(cstr, strlen(cstr));
+}
+
+String::String(char c) : buffer(NULL), capacity(0), len(0)
+{
+  assign(&c, 1);
+}
+
+String::String(int value, unsigned char base) : buffer(NULL), capacity(0), len(0)
+{
+  char buf[34];
+  snprintf(buf, sizeof(buf), base == 16 ? "%x" : "%d", value);
+  assign(buf, strlen(buf));
+}
+
+String::String(unsigned int value, unsigned char base) : buffer(NULL), capacity(0), len(0)
+{
+  char buf[34];
+  snprintf(buf, sizeof(buf), base == 16 ? "%x" : "%u", value);
+  assign(buf, strlen(buf));
+}
+
+String::String(long value, unsigned char base) : buffer(NULL), capacity(0), len(0)
+{
+  char buf[34];
+  snprintf(buf, sizeof(buf), base == 16 ? "%lx" : "%ld", value);
+  assign(buf, strlen(buf));
+}
+
+String::String(unsigned long value, unsigned char base) : buffer(NULL), capacity(0), len(0)
+{
+  char buf[34];
+  snprintf(buf, sizeof(buf), base == 16 ? "%lx" : "%lu", value);
+  assign(buf, strlen(buf));
+}
+
+String::~String()
+{
+  free(buffer);
+}
+
+String &String::operator=(const String &rhs)
+{
+  if (this != &rhs) {
+    assign(rhs.buffer, rhs.len);
+  }
+  return *this;
+}
+
+String &String::operator=(const char *cstr)
+{
+  assign(cstr ? cstr : "", cstr ? strlen(cstr) : 0);
+  return *this;
+}
+
+unsigned char String::concat(const String &str)
+{
+  append(str.buffer, str.len);
+  return 1;
+}
+
+unsigned char String::concat(const char *cstr)
+{
+  if (cstr) {
+    append(cstr, strlen(cstr));
+  }
+  return 1;
+}
+
+unsigned char String::concat(char c)
+{
+  append(&c, 1);
+  return 1;
+}
+
+String operator+(const String &lhs, const String &rhs)
+{
+  String out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+String operator+(const String &lhs, const char *cstr)
+{
+  String out(lhs);
+  out.concat(cstr);
+  return out;
+}
+
+char String::charAt(unsigned int index) const
+{
+  return (index < len) ? buffer[index] : 0;
+}
+
+unsigned char String::equals(const String &s) const
+{
+  return len == s.len && memcmp(buffer, s.buffer, len) == 0;
+}
+
+void String::assign(const char *cstr, size_t length)
+{
+  len = 0;
+  append(cstr, length);
+}
+
+void String::append(const char *cstr, size_t length)
+{
+  if (len + length + 1 > capacity) {
+    capacity = len + length + 1;
+    buffer = (char *)realloc(buffer, capacity);
+  }
+  memmove(buffer + len, cstr, length);
+  len += length;
+  buffer[len] = 0;
+}
@@ -0,0 +1,53 @@
+/*
+   Minimal Arduino String shim for host builds.
+*/
+#ifndef String_class_h
+#define String_class_h
+
+#include <stddef.h>
+
+class __FlashStringHelper;
+
+class String
+{
+  public:
+    String(const char *cstr = "");
+    String(const String &str);
+    String(const __FlashStringHelper *str);
+    explicit String(char c);
+    explicit String(int value, unsigned char base = 10);
+    explicit String(unsigned int value, unsigned char base = 10);
+    explicit String(long value, unsigned char base = 10);
+    explicit String(unsigned long value, unsigned char base = 10);
+    ~String();
+
+    String &operator=(const String &rhs);
+    String &operator=(const char *cstr);
+
+    unsigned char concat(const String &str);
+    unsigned char concat(const char *cstr);
+    unsigned char concat(char c);
+    String &operator+=(const String &rhs) { concat(rhs); return *this; }
+    String &operator+=(const char *cstr) { concat(cstr); return *this; }
+    String &operator+=(char c) { concat(c); return *this; }
+
+    friend String operator+(const String &lhs, const String &rhs);
+    friend String operator+(const String &lhs, const char *cstr);
+
+    unsigned int length(void) const { return len; }
+    const char *c_str() const { return buffer; }
+    char charAt(unsigned int index) const;
+    char operator[](unsigned int index) const { return charAt(index); }
+    unsigned char equals(const String &s) const;
+    unsigned char operator==(const String &rhs) const { return equals(rhs); }
+    unsigned char operator!=(const String &rhs) const { return !equals(rhs); }
+
+  private:
+    void assign(const char *cstr, size_t length);
+    void append(const char *cstr, size_t length);
+    char *buffer;
+    unsigned int capacity;
+    unsigned int len;
+};
+
+#endif
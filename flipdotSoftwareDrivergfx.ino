@@ -1,4 +1,7 @@
 #include "Modbus_CoProcessor.h"
+#include "Flipdot_Benchmark.h"
+#include "Modbus_Ingest.h"
+#include "Modbus_Pacer.h"
 
 // Please install Adafruit GFX: https://learn.adafruit.com/adafruit-gfx-graphics-library/overview
 #include <Adafruit_GFX.h>
@@ -6,17 +9,43 @@
 
 int statusLed = 13; // LED used for status
 
-mcp mcp(19200); // Prepare object, set serial baud to 19200
+// Set to 1 to time each phase of UpdateSign() instead of running the demo.
+// Results are printed on the USB serial port (Serial).
+#define RUN_BENCHMARK 0
+
+// Set to 1 to show frames sent by a computer on the USB serial port (Serial)
+// instead of running the demo, see Modbus_Ingest.h.
+#define RUN_INGEST 0
+
+mcpFrontSign mcp(19200); // Prepare object for the 98x16 front sign (ID 6), set serial baud to 19200
+
+#if RUN_INGEST
+mcpIngestServer<98> ingest(mcp, Serial);
+#endif
 
 void setup() {
   pinMode(statusLed, OUTPUT);
 
   delay(1000);
 
+  // mcp.setResponsePacing(true); // Send each line as soon as the sign answers the last one
+  // mcp.loadCalibration(); // Use the line delay calibrateLineDelay() found on an earlier boot (see Modbus_Calibrate.cpp)
+
   digitalWrite(statusLed, HIGH);
   mcp.InitSign(); // This usually should only be run once after the sign is first powered on.
   digitalWrite(statusLed, LOW);
 
+#if RUN_BENCHMARK
+  Serial.begin(115200);
+  mcpBenchmarkAll(mcp, Serial);
+  return;
+#endif
+
+#if RUN_INGEST
+  Serial.begin(115200);
+  return;
+#endif
+
 
   // Turn on all dots as a test
   delay(1000);
@@ -69,14 +98,15 @@ void setup() {
 
 
 
-  // Display a circle that moves across the sign
-  for (int i = 0; i < xSize; i++) {
+  // Display a circle that moves across the sign, as fast as the sign takes it
+  mcpPacer pacer(mcp);
+  for (int i = 0; i < mcp.width(); i++) {
+    pacer.waitForFrame(); // Until the last frame is sent and settled, see setSettleTime()
     digitalWrite(statusLed, HIGH);
     mcp.dotAllOff();
     mcp.fillCircle(i, 7, 5, 1);
     mcp.UpdateSign();
     digitalWrite(statusLed, LOW);
-    delay(700);
   }
 
   digitalWrite(statusLed, HIGH);
@@ -93,6 +123,11 @@ void setup() {
 }
 
 void loop() {
+#if RUN_INGEST
+  ingest.poll();
+  return;
+#endif
+
   // Flash LED to indicate program is finished.
   digitalWrite(statusLed, HIGH);   // turn the LED on (HIGH is the voltage level)
   delay(50);               // wait for a second